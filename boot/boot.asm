@@ -51,8 +51,9 @@ _start:
     ; Stack below 1MB
     mov esp, 0x90000
 
-    ; Save multiboot pointer
+    ; Save multiboot pointer and magic (first two kernel_main arguments)
     mov edi, ebx
+    mov esi, eax
 
     ; Setup identity mapping and higher-half mapping
     ; P4[0] = P3 identity
@@ -107,7 +108,8 @@ _start:
     cmp ecx, 64
     jl .map_p2_high
 
-    ; NEW: Map 0-128MB to direct map region with 2MB pages (64 pages)
+    ; NEW: Map 0-1GB to direct map region with 2MB pages (512 pages)
+    ; (PHYS_DIRECT_MAP_BOOT_END in mm/memory_layout.h must match)
     mov ecx, 0
 .map_p2_direct:
     mov eax, 0x200000
@@ -115,7 +117,7 @@ _start:
     or eax, 0x83
     mov [boot_p2_direct + ecx*8], eax
     inc ecx
-    cmp ecx, 64
+    cmp ecx, 512
     jl .map_p2_direct
 
     ; Load page table
@@ -18,6 +18,10 @@ kernel_entry:
     lea rsp, [rel stack_top]
 
     ; Jump to C kernel
+    ; edi/esi still hold the multiboot info pointer and magic from boot.asm,
+    ; the upper halves are undefined after the switch to long mode
+    mov edi, edi
+    mov esi, esi
     call kernel_main
 
     ; Hang if kernel returns
@@ -0,0 +1,143 @@
+#include "multiboot2.h"
+#include "mm/memory_layout.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+static memory_region_t regions[MULTIBOOT2_MAX_REGIONS];
+static uint32_t region_count = 0;
+static uint8_t acpi_rsdp[MULTIBOOT2_RSDP_MAX];
+static uint32_t acpi_rsdp_length = 0;
+static uint32_t acpi_rsdp_tag = 0;
+static uint64_t acpi_reclaimable_bytes = 0;
+
+// Tags are padded to 8-byte boundaries
+#define MULTIBOOT2_TAG_ALIGN(size) (((size) + 7) & ~7ULL)
+
+static void add_region(uint64_t base, uint64_t length, uint32_t type) {
+    if (length == 0) return;
+
+    if (region_count >= MULTIBOOT2_MAX_REGIONS) {
+        serial_debug_puts("[MB2] Memory map too large, dropping region\n");
+        return;
+    }
+
+    // Insertion sort by base address (firmware maps are usually sorted already)
+    uint32_t i = region_count;
+    while (i > 0 && regions[i - 1].base > base) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+
+    regions[i].base = base;
+    regions[i].length = length;
+    regions[i].type = type;
+    region_count++;
+
+    if (type == MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE) {
+        acpi_reclaimable_bytes += length;
+    }
+}
+
+static void parse_mmap(const multiboot2_tag_mmap_t* tag) {
+    if (tag->entry_size < sizeof(multiboot2_mmap_entry_t)) return;
+
+    const uint8_t* entry = (const uint8_t*)tag + sizeof(multiboot2_tag_mmap_t);
+    const uint8_t* end = (const uint8_t*)tag + tag->size;
+
+    while (entry + sizeof(multiboot2_mmap_entry_t) <= end) {
+        const multiboot2_mmap_entry_t* e = (const multiboot2_mmap_entry_t*)entry;
+        add_region(e->base_addr, e->length, e->type);
+        entry += tag->entry_size;
+    }
+}
+
+kerr_t multiboot2_parse(uint64_t info_phys, uint64_t magic) {
+    region_count = 0;
+    acpi_rsdp_length = 0;
+    acpi_rsdp_tag = 0;
+    acpi_reclaimable_bytes = 0;
+
+    if ((uint32_t)magic != MULTIBOOT2_BOOTLOADER_MAGIC || info_phys == 0 || (info_phys & 7)) {
+        serial_debug_puts("[MB2] No valid Multiboot2 information\n");
+        return E_INVALID;
+    }
+
+    const uint8_t* info = (const uint8_t*)PHYS_TO_VIRT(info_phys);
+    uint32_t total_size = *(const uint32_t*)info;
+
+    // Tags start after the 8-byte fixed header
+    const uint8_t* ptr = info + 8;
+    const uint8_t* end = info + total_size;
+
+    while (ptr + sizeof(multiboot2_tag_t) <= end) {
+        const multiboot2_tag_t* tag = (const multiboot2_tag_t*)ptr;
+        if (tag->type == MULTIBOOT2_TAG_END) break;
+
+        switch (tag->type) {
+            case MULTIBOOT2_TAG_MMAP:
+                parse_mmap((const multiboot2_tag_mmap_t*)tag);
+                break;
+            case MULTIBOOT2_TAG_ACPI_OLD:
+            case MULTIBOOT2_TAG_ACPI_NEW:
+                // Prefer the ACPI 2.0+ RSDP when both are present. The tag holds a
+                // copy of the RSDP inside the boot info, so keep our own copy.
+                if (acpi_rsdp_tag != MULTIBOOT2_TAG_ACPI_NEW) {
+                    uint32_t len = tag->size - sizeof(multiboot2_tag_t);
+                    if (len > MULTIBOOT2_RSDP_MAX) len = MULTIBOOT2_RSDP_MAX;
+                    memcpy(acpi_rsdp, ptr + sizeof(multiboot2_tag_t), len);
+                    acpi_rsdp_length = len;
+                    acpi_rsdp_tag = tag->type;
+                }
+                break;
+            default:
+                break;
+        }
+
+        ptr += MULTIBOOT2_TAG_ALIGN(tag->size);
+    }
+
+    serial_debug_puts("[MB2] Memory map regions: ");
+    char num_str[32];
+    uitoa(region_count, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_putc('\n');
+
+    for (uint32_t i = 0; i < region_count; i++) {
+        serial_debug_puts("[MB2]   0x");
+        serial_puthex(COM1, regions[i].base, 16);
+        serial_debug_puts(" - 0x");
+        serial_puthex(COM1, regions[i].base + regions[i].length, 16);
+        serial_debug_puts(" ");
+        serial_debug_puts(multiboot2_region_type_name(regions[i].type));
+        serial_debug_putc('\n');
+    }
+
+    if (region_count == 0) return E_NOTFOUND;
+
+    return E_OK;
+}
+
+const memory_region_t* multiboot2_get_regions(uint32_t* count) {
+    if (count) *count = region_count;
+    return region_count ? regions : NULL;
+}
+
+const void* multiboot2_get_acpi_rsdp(uint32_t* length) {
+    if (length) *length = acpi_rsdp_length;
+    return acpi_rsdp_length ? acpi_rsdp : NULL;
+}
+
+uint64_t multiboot2_get_acpi_reclaimable(void) {
+    return acpi_reclaimable_bytes;
+}
+
+const char* multiboot2_region_type_name(uint32_t type) {
+    switch (type) {
+        case MULTIBOOT2_MEMORY_AVAILABLE:        return "available";
+        case MULTIBOOT2_MEMORY_RESERVED:         return "reserved";
+        case MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE: return "ACPI reclaimable";
+        case MULTIBOOT2_MEMORY_NVS:              return "ACPI NVS";
+        case MULTIBOOT2_MEMORY_BADRAM:           return "bad RAM";
+        default:                                 return "unknown";
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MULTIBOOT2_H
+#define MULTIBOOT2_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+
+// Value left in EAX by a Multiboot2 compliant bootloader
+#define MULTIBOOT2_BOOTLOADER_MAGIC 0x36D76289
+
+// Boot information tag types we care about
+#define MULTIBOOT2_TAG_END          0
+#define MULTIBOOT2_TAG_BASIC_MEMINFO 4
+#define MULTIBOOT2_TAG_MMAP         6
+#define MULTIBOOT2_TAG_ACPI_OLD     14
+#define MULTIBOOT2_TAG_ACPI_NEW     15
+
+// Memory map entry types
+#define MULTIBOOT2_MEMORY_AVAILABLE        1
+#define MULTIBOOT2_MEMORY_RESERVED         2
+#define MULTIBOOT2_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT2_MEMORY_NVS              4
+#define MULTIBOOT2_MEMORY_BADRAM           5
+
+// Maximum number of memory map regions kept after parsing
+#define MULTIBOOT2_MAX_REGIONS 64
+
+// Size of an ACPI 2.0+ RSDP (the 1.0 structure is 20 bytes)
+#define MULTIBOOT2_RSDP_MAX 36
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+} __attribute__((packed)) multiboot2_tag_t;
+
+typedef struct {
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot2_mmap_entry_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+    // multiboot2_mmap_entry_t entries[] follow
+} __attribute__((packed)) multiboot2_tag_mmap_t;
+
+// Sanitized copy of one memory map region (the boot info itself is not kept)
+typedef struct {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+} memory_region_t;
+
+// Parse the boot information structure passed in EBX by the bootloader
+// Must run before anything can overwrite the memory holding it
+kerr_t multiboot2_parse(uint64_t info_phys, uint64_t magic);
+
+// Get the sorted memory map (NULL/0 if the bootloader provided none)
+const memory_region_t* multiboot2_get_regions(uint32_t* count);
+
+// Copy of the ACPI RSDP provided by the bootloader (NULL if none)
+const void* multiboot2_get_acpi_rsdp(uint32_t* length);
+
+// Bytes of ACPI-reclaimable memory reported by the memory map
+uint64_t multiboot2_get_acpi_reclaimable(void);
+
+const char* multiboot2_region_type_name(uint32_t type);
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "libc/stdint.h"
+
+// Small x86-64 helpers shared by the memory manager, scheduler and benchmarks
+
+// Read the time stamp counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Execute CPUID for leaf (subleaf 0)
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+// CPUID 0x80000001 EDX: 1GB pages in PDPT entries
+#define CPUID_EXT_EDX_PDPE1GB (1U << 26)
+
+// Check if the CPU can map 1GB pages
+static inline int cpu_has_gbpages(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000001) return 0;
+
+    cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EXT_EDX_PDPE1GB) != 0;
+}
+
+// CPUID 1 ECX: process-context identifiers (CR4.PCIDE)
+#define CPUID_ECX_PCID (1U << 17)
+// CPUID 7 EBX: INVPCID instruction
+#define CPUID_7_EBX_INVPCID (1U << 10)
+
+// Check if the CPU has PCIDs and the INVPCID instruction to manage them
+static inline int cpu_has_pcid(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 7) return 0;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(ecx & CPUID_ECX_PCID)) return 0;
+
+    cpuid(7, &eax, &ebx, &ecx, &edx);
+    return (ebx & CPUID_7_EBX_INVPCID) != 0;
+}
+
+#define CR4_PCIDE (1ULL << 17)
+
+// CR3 bit 63: keep the TLB entries of the PCID being loaded
+#define CR3_NOFLUSH (1ULL << 63)
+
+static inline uint64_t read_cr4(void) {
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void write_cr4(uint64_t cr4) {
+    asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+// INVPCID types
+#define INVPCID_ADDRESS     0   // One address in one PCID
+#define INVPCID_CONTEXT     1   // Everything tagged with one PCID
+#define INVPCID_ALL_GLOBAL  2   // Every PCID, global pages included
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t addr) {
+    struct { uint64_t pcid; uint64_t addr; } desc = { pcid, addr };
+    asm volatile("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+// CPUID 1 EDX: on-chip local APIC
+#define CPUID_EDX_APIC (1U << 9)
+// CPUID 0x80000007 EDX: TSC runs at a constant rate in every P-, C- and T-state
+#define CPUID_EXT7_EDX_INVARIANT_TSC (1U << 8)
+
+// Check if the CPU has a local APIC
+static inline int cpu_has_apic(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EDX_APIC) != 0;
+}
+
+// Check if the TSC can serve as a clocksource across power states
+static inline int cpu_has_invariant_tsc(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) return 0;
+
+    cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EXT7_EDX_INVARIANT_TSC) != 0;
+}
+
+// IA32_APIC_BASE: physical base of the local APIC registers, enable bit
+#define MSR_APIC_BASE 0x1B
+
+// Read and write model-specific registers
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// Zero size bytes (a multiple of 32, 8-byte aligned) with non-temporal
+// stores, which bypass the caches instead of evicting the working set
+static inline void memzero_nt(void* dst, uint64_t size) {
+    uint64_t* p = (uint64_t*)dst;
+    for (uint64_t i = 0; i < size / sizeof(uint64_t); i += 4) {
+        asm volatile("movnti %1, %0" : "=m"(p[i]) : "r"(0ULL));
+        asm volatile("movnti %1, %0" : "=m"(p[i + 1]) : "r"(0ULL));
+        asm volatile("movnti %1, %0" : "=m"(p[i + 2]) : "r"(0ULL));
+        asm volatile("movnti %1, %0" : "=m"(p[i + 3]) : "r"(0ULL));
+    }
+    // Make the stores visible before the memory is handed out
+    asm volatile("sfence" : : : "memory");
+}
+
+// Index of the lowest set bit (value must be non-zero)
+static inline uint64_t bit_scan_forward(uint64_t value) {
+    return (uint64_t)__builtin_ctzll(value);
+}
+
+// Number of set bits (no libgcc available, so no __builtin_popcountll)
+static inline uint64_t bit_count(uint64_t value) {
+    value = value - ((value >> 1) & 0x5555555555555555ULL);
+    value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+    value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (value * 0x0101010101010101ULL) >> 56;
+}
+
+// L1/L2 cache line size on every x86-64 part we run on
+#define CACHE_LINE_SIZE 64
+
+// Number of per-CPU slots kept by per-CPU data structures
+// Only the boot CPU runs until SMP bring-up exists
+#define MAX_CPUS 1
+
+// Index of the CPU we are running on
+static inline uint32_t cpu_current_id(void) {
+    return 0;
+}
+
+// Disable interrupts, returning the previous RFLAGS for irq_restore()
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// Restore the interrupt flag saved by irq_save()
+static inline void irq_restore(uint64_t flags) {
+    asm volatile("pushq %0; popfq" : : "r"(flags) : "memory", "cc");
+}
+
+#define RFLAGS_IF (1ULL << 9)
+
+// Check if interrupts are enabled
+static inline int irq_enabled(void) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0" : "=r"(flags));
+    return (flags & RFLAGS_IF) != 0;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include "libc/stdint.h"
+
+// Sequence lock for small data read far more often than it is written.
+// A writer makes the sequence odd while it updates; a reader retries if the
+// sequence was odd or changed while it read. Readers never write shared
+// state, so they are safe in interrupt context. Writers must run with
+// interrupts off, so a reader on the same CPU cannot interrupt an update.
+typedef struct {
+    volatile uint32_t sequence;
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0 }
+
+static inline uint32_t read_seqbegin(const seqlock_t* lock) {
+    uint32_t seq;
+    do {
+        seq = lock->sequence;
+    } while (seq & 1);
+    asm volatile("" : : : "memory");
+    return seq;
+}
+
+// Non-zero if the data read since read_seqbegin() may be torn
+static inline int read_seqretry(const seqlock_t* lock, uint32_t seq) {
+    asm volatile("" : : : "memory");
+    return lock->sequence != seq;
+}
+
+static inline void write_seqlock(seqlock_t* lock) {
+    lock->sequence++;
+    asm volatile("" : : : "memory");
+}
+
+static inline void write_sequnlock(seqlock_t* lock) {
+    asm volatile("" : : : "memory");
+    lock->sequence++;
+}
+
+#endif
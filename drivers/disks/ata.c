@@ -5,6 +5,12 @@
 #include "console/console.h"
 #include "libc/string.h"
 #include "error_handling/errno.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
+
+// Polling: give up after ATA_TIMEOUT_NS, sleep ATA_POLL_NS between reads
+#define ATA_TIMEOUT_NS (1 * NSEC_PER_SEC)
+#define ATA_POLL_NS    (10 * NSEC_PER_USEC)
 
 typedef struct {
     uint16_t base;// Base I/O port
@@ -38,14 +44,15 @@ static void ata_wait_busy(uint16_t base){
 //Helper function to wait for data to be ready
 static kerr_t ata_wait_drq(uint16_t base){
     uint8_t status;
-    int timeout = 1000000;
+    uint64_t deadline = ktime_get_ns() + ATA_TIMEOUT_NS;
 
-    while(timeout--){
+    while(1){
         status = inb(base + 7);
         if(status & ATA_SR_ERR) return E_HARDWARE;
         if(status & ATA_SR_DRQ) return E_OK;
+        if(ktime_get_ns() >= deadline) return E_TIMEOUT;
+        schedule_timeout(ATA_POLL_NS);
     }
-    return E_TIMEOUT;
 }
 
 // Delay 400ns by reading 4 times(best approximation)
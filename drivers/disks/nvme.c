@@ -11,6 +11,8 @@
 #include "interrupts/idt.h"
 #include "mm/memory_layout.h"
 #include "mm/vmm.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
 
 // PCI Configuration Space
 #define PCI_CONFIG_ADDRESS 0xCF8
@@ -23,6 +25,10 @@
 #define PCI_BAR0           0x10
 #define PCI_BAR1           0x14
 
+// Polling: give up after NVME_TIMEOUT_NS, sleep NVME_POLL_NS between reads
+#define NVME_TIMEOUT_NS (5 * NSEC_PER_SEC)
+#define NVME_POLL_NS    (10 * NSEC_PER_USEC)
+
 // PCI Command register bits
 #define PCI_COMMAND_IO          0x01
 #define PCI_COMMAND_MEMORY      0x02
@@ -231,10 +237,9 @@ static void nvme_submit_command(nvme_controller_t* ctrl, nvme_queue_pair_t* qp,
 //Wait for command completion
 static kerr_t nvme_wait_completion(nvme_controller_t* ctrl, nvme_queue_pair_t* qp,
                                    uint16_t cid, uint8_t is_admin){
-    uint32_t timeout = 5e6;//5-second timeout
-
+    uint64_t deadline = ktime_get_ns() + NVME_TIMEOUT_NS;
 
-    while(timeout--){
+    while(1){
         nvme_cq_entry_t* cqe = &qp->cq[qp->cq_head];
         uint8_t phase = (cqe->status >> 0) & 1;
 
@@ -259,10 +264,9 @@ static kerr_t nvme_wait_completion(nvme_controller_t* ctrl, nvme_queue_pair_t* q
                 return (status == NVME_SC_SUCCESS) ? E_OK : E_HARDWARE;
             }
         }
-        //For small delay
-        for (volatile uint8_t i = 0; i < 100; i++);
+        if (ktime_get_ns() >= deadline) return E_TIMEOUT;
+        schedule_timeout(NVME_POLL_NS);
     }
-    return E_TIMEOUT;
 }
 
 //Create I/O completion queue
@@ -554,9 +558,9 @@ kerr_t nvme_init() {
     nvme_write32(&nvme_ctrl, NVME_REG_CC, cc);
 
     //Wait for controller to be disabled
-    uint32_t timeout = 1000000;
+    uint64_t deadline = ktime_get_ns() + NVME_TIMEOUT_NS;
     uint32_t csts;
-    while (timeout--) {
+    while (ktime_get_ns() < deadline) {
         csts = nvme_read32(&nvme_ctrl, NVME_REG_CSTS);
         if (!(csts & NVME_CSTS_RDY)) {
             serial_debug_puts("[NVME] Controller disabled (CSTS: 0x");
@@ -565,8 +569,7 @@ kerr_t nvme_init() {
             break;
         }
 
-        // Small delay
-        for (volatile int i = 0; i < 10; i++);
+        schedule_timeout(NVME_POLL_NS);
     }
 
     if (nvme_read32(&nvme_ctrl, NVME_REG_CSTS) & NVME_CSTS_RDY) {
@@ -631,8 +634,9 @@ kerr_t nvme_init() {
 
     // Wait for controller to be ready
     serial_debug_puts("[NVME] Waiting for controller ready...\n");
-    timeout = 5000000;  // 5 second timeout
-    while (timeout--) {
+    deadline = ktime_get_ns() + NVME_TIMEOUT_NS;
+    uint64_t next_report = ktime_get_ns() + 500 * NSEC_PER_MSEC;
+    while (ktime_get_ns() < deadline) {
         csts = nvme_read32(&nvme_ctrl, NVME_REG_CSTS);
 
         // Check for fatal error
@@ -650,15 +654,15 @@ kerr_t nvme_init() {
             break;
         }
 
-        // Debug every 500k iterations
-        if (timeout % 500000 == 0) {
+        // Debug every 500ms
+        if (ktime_get_ns() >= next_report) {
+            next_report += 500 * NSEC_PER_MSEC;
             serial_debug_puts("[NVME] Still waiting... CSTS: 0x");
             serial_puthex(COM1, csts, 8);
             serial_debug_puts("\n");
         }
 
-        // Small delay
-        for (volatile int i = 0; i < 10; i++);
+        schedule_timeout(NVME_POLL_NS);
     }
 
     if (!(nvme_read32(&nvme_ctrl, NVME_REG_CSTS) & NVME_CSTS_RDY)) {
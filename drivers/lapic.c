@@ -0,0 +1,157 @@
+#include "lapic.h"
+#include "pit.h"
+#include "driver.h"
+#include "interrupts/idt.h"
+#include "mm/vmalloc.h"
+#include "cpu/cpu.h"
+#include "io/serial.h"
+#include "libc/stddef.h"
+#include "libc/string.h"
+#include "time/ktime.h"
+
+extern void irq_lapic_timer();
+extern void irq_spurious();
+
+static volatile uint32_t* lapic = NULL;
+static uint64_t timer_khz = 0;
+static lapic_timer_callback_t timer_callback = NULL;
+static uint64_t timer_interrupts = 0;
+
+// Forward declaration of driver init function
+static kerr_t lapic_driver_init(driver_t* drv);
+
+// Driver structure
+static driver_t lapic_driver = {
+    .name = "LAPIC",
+    .type = DRIVER_TYPE_TIMER,
+    .version = 1,
+    .priority = 25,  // Initialize after PIT (priority 20)
+    .init = lapic_driver_init,
+    .cleanup = NULL,
+    .depends_on = "PIT",  // Timer is calibrated against the PIT
+    .driver_data = NULL
+};
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / sizeof(uint32_t)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / sizeof(uint32_t)] = value;
+}
+
+// Count timer clocks over a fixed PIT interval
+static uint64_t calibrate_timer_khz(void) {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+
+    uint64_t flags = irq_save();
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    pit_wait_ms(LAPIC_CALIBRATE_MS);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+    irq_restore(flags);
+
+    return elapsed / LAPIC_CALIBRATE_MS;
+}
+
+// Driver initialization function (actual LAPIC setup)
+static kerr_t lapic_driver_init(driver_t* drv) {
+    if (!cpu_has_apic()) {
+        serial_debug_puts("[LAPIC] No local APIC\n");
+        return E_NOTFOUND;
+    }
+
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+    uint64_t phys = base & 0x000FFFFFFFFFF000ULL;
+    wrmsr(MSR_APIC_BASE, base | LAPIC_BASE_ENABLE);
+
+    // Registers are MMIO above RAM, outside the direct map
+    lapic = vmap_range(phys, PAGE_SIZE, PAGE_PRESENT | PAGE_WRITE |
+                                        PAGE_WRITE_THROUGH | PAGE_CACHE_DISABLE);
+    if (!lapic) return E_NOMEM;
+
+    // Virtual wire mode: PIC interrupts keep arriving through LINT0
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_DELIVERY_EXTINT);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_DELIVERY_NMI);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    timer_khz = calibrate_timer_khz();
+    if (timer_khz == 0) {
+        serial_debug_puts("[LAPIC] Timer calibration failed\n");
+        return E_INVALID;
+    }
+
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint64_t)irq_lapic_timer, 0x08, 0x8E);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uint64_t)irq_spurious, 0x08, 0x8E);
+
+    // One-shot mode, unmasked; nothing fires until a count is written
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+
+    serial_debug_puts("[LAPIC] ID ");
+    char num_str[21];
+    uitoa(lapic_read(LAPIC_ID) >> 24, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" at 0x");
+    serial_puthex(COM1, phys, 16);
+    serial_debug_puts(", timer ");
+    uitoa(timer_khz, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" kHz\n");
+
+    return E_OK;
+}
+
+// Public init function - registers the driver
+kerr_t lapic_register(void) {
+    return driver_register(&lapic_driver);
+}
+
+int lapic_available(void) {
+    return timer_khz != 0;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+uint64_t lapic_timer_khz(void) {
+    return timer_khz;
+}
+
+void lapic_timer_oneshot(uint64_t ns) {
+    if (!timer_khz) return;
+
+    // Clamp first so the product cannot overflow
+    uint64_t max_ns = 0xFFFFFFFFULL * NSEC_PER_MSEC / timer_khz;
+    if (ns > max_ns) ns = max_ns;
+
+    uint64_t count = ns * timer_khz / NSEC_PER_MSEC;
+    if (count == 0) count = 1;
+    lapic_write(LAPIC_TIMER_INITIAL, (uint32_t)count);
+}
+
+void lapic_timer_cancel(void) {
+    if (!timer_khz) return;
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+}
+
+void lapic_set_timer_callback(lapic_timer_callback_t callback) {
+    timer_callback = callback;
+}
+
+uint64_t lapic_get_timer_interrupts(void) {
+    return timer_interrupts;
+}
+
+void lapic_timer_handler(void) {
+    timer_interrupts++;
+
+    // EOI first: the callback may switch tasks before this returns
+    lapic_eoi();
+
+    if (timer_callback) {
+        timer_callback();
+    }
+}
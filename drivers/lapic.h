@@ -0,0 +1,57 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+
+// Local APIC register offsets
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080   // Task priority
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0   // Spurious interrupt vector
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_BASE_ENABLE       (1ULL << 11)   // IA32_APIC_BASE global enable
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_DELIVERY_NMI      0x400
+#define LAPIC_DELIVERY_EXTINT   0x700
+#define LAPIC_DIVIDE_16         0x3
+
+// Vectors above the remapped PIC range (32-47)
+#define LAPIC_TIMER_VECTOR      0x30
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+// Timer calibration against PIT channel 2
+#define LAPIC_CALIBRATE_MS      50
+
+typedef void (*lapic_timer_callback_t)(void);
+
+kerr_t lapic_register(void);
+
+// Non-zero once the local APIC is enabled and its timer calibrated
+int lapic_available(void);
+
+void lapic_eoi(void);
+
+// Timer input rate after the divider, in kHz
+uint64_t lapic_timer_khz(void);
+
+// Raise one timer interrupt ns from now, replacing any pending one. The
+// 32-bit counter caps the delay (about 68s at a 62.5MHz timer clock).
+void lapic_timer_oneshot(uint64_t ns);
+void lapic_timer_cancel(void);
+
+// Called from the timer interrupt after the EOI
+void lapic_set_timer_callback(lapic_timer_callback_t callback);
+void lapic_timer_handler(void);
+
+// Timer interrupts taken
+uint64_t lapic_get_timer_interrupts(void);
+
+#endif
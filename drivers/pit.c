@@ -4,9 +4,28 @@
 #include "error_handling/errno.h"
 #include "libc/stddef.h"
 #include "scheduler/task.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
+#include "lapic.h"
 
 static volatile uint64_t pit_ticks = 0;
-static pit_callback_t tick_callback = 0;
+static uint32_t pit_divisor = 0;
+
+// Tickless idle. Input clocks that do not make up a whole tick yet are carried
+// in pit_residual, so stopping and restarting the tick loses no time.
+static uint32_t pit_residual = 0;
+static uint32_t oneshot_count = 0;  // Count armed in mode 0, 0 while periodic
+
+// With a LAPIC the tick stops outright and an hrtimer, which shares the LAPIC
+// one-shot with every other timer, ends the idle period. The TSC clock says
+// how long it lasted.
+static hrtimer_t idle_timer;
+static int tick_stopped = 0;
+static uint64_t stopped_at_ns = 0;
+
+// Statistics
+static uint64_t pit_interrupts = 0;
+static uint64_t tickless_entries = 0;
 
 // Forward declaration of driver init function
 static kerr_t pit_driver_init(driver_t* drv);
@@ -23,10 +42,91 @@ static driver_t pit_driver = {
     .driver_data = NULL
 };
 
+// Program channel 0 with a mode and a 16-bit count
+static void pit_program(uint8_t mode, uint32_t count) {
+    // Channel 0, Access mode lohibyte
+    outb(PIT_COMMAND, PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | mode);
+
+    // Send count (low byte, then high byte)
+    outb(PIT_CHANNEL0, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL0, (uint8_t)((count >> 8) & 0xFF));
+}
+
+// Credit elapsed input clocks to the tick count
+static void pit_account(uint64_t clocks) {
+    uint64_t total = pit_residual + clocks;
+    pit_ticks += total / pit_divisor;
+    pit_residual = (uint32_t)(total % pit_divisor);
+}
+
+// IRQ0 raised but not yet delivered
+static int pit_irq_pending(void) {
+    outb(0x20, 0x0A);  // Master PIC: read IRR
+    return inb(0x20) & 0x01;
+}
+
+// Input clocks of the current period that have already passed
+static uint32_t pit_period_elapsed(void) {
+    outb(PIT_COMMAND, PIT_CHANNEL_0 | PIT_ACCESS_LATCH);
+    uint32_t remaining = inb(PIT_CHANNEL0);
+    remaining |= (uint32_t)inb(PIT_CHANNEL0) << 8;
+    if (remaining == 0 || remaining > pit_divisor) remaining = pit_divisor;
+    return pit_divisor - remaining;
+}
+
+// The interrupt alone ends the idle hlt; the tick restarts in pit_tickless_exit()
+static void pit_idle_wakeup(hrtimer_t* timer) {
+    (void)timer;
+}
+
+// LAPIC-driven tickless idle for up to ticks ticks
+static int pit_tickless_enter_lapic(uint64_t ticks) {
+    if (ticks > PIT_TICKLESS_MAX_TICKS) ticks = PIT_TICKLESS_MAX_TICKS;
+
+    uint64_t saved_ticks = pit_ticks;
+    uint32_t saved_residual = pit_residual;
+    pit_account(pit_period_elapsed());
+
+    // Mode 0 without a count: channel 0 holds OUT low and stops counting
+    outb(PIT_COMMAND, PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | PIT_MODE_INTERRUPT_ON_TERMINAL_COUNT);
+
+    // The period ended while switching over: undo, that interrupt is a plain tick
+    if (pit_irq_pending()) {
+        pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+        pit_ticks = saved_ticks;
+        pit_residual = saved_residual;
+        return 0;
+    }
+
+    // Wake on the tick boundary the sleeper waits for
+    stopped_at_ns = ktime_get_ns();
+    uint64_t clocks = ticks * pit_divisor - pit_residual;
+    hrtimer_setup(&idle_timer, pit_idle_wakeup, NULL);
+    if (hrtimer_start(&idle_timer, stopped_at_ns + clocks * NSEC_PER_SEC / PIT_FREQUENCY) != E_OK) {
+        pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+        return 0;
+    }
+
+    tick_stopped = 1;
+    tickless_entries++;
+    return 1;
+}
+
+static void pit_tickless_exit_lapic(void) {
+    hrtimer_cancel(&idle_timer);
+
+    uint64_t elapsed_ns = ktime_get_ns() - stopped_at_ns;
+    pit_account(elapsed_ns * PIT_FREQUENCY / NSEC_PER_SEC);
+    tick_stopped = 0;
+    pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+
+    // The tick normally keeps the clock rebased; it was off for a while
+    ktime_tick();
+}
+
 // Driver initialization function (actual PIT setup)
 static kerr_t pit_driver_init(driver_t* drv) {
-    // Default frequency: 100 Hz
-    uint32_t frequency = 100;
+    uint32_t frequency = PIT_TICK_HZ;
 
     // Calculate the divisor for the desired frequency
     uint32_t divisor = PIT_FREQUENCY / frequency;
@@ -35,16 +135,12 @@ static kerr_t pit_driver_init(driver_t* drv) {
     if (divisor < 1) divisor = 1;
     if (divisor > 65535) divisor = 65535;
 
-    // Send command byte:
-    // Channel 0, Access mode lohibyte, Rate generator mode
-    uint8_t command = PIT_CHANNEL_0 | PIT_ACCESS_LOHIBYTE | PIT_MODE_RATE_GENERATOR;
-    outb(PIT_COMMAND, command);
-
-    // Send divisor (low byte, then high byte)
-    outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xFF));
-    outb(PIT_CHANNEL0, (uint8_t)((divisor >> 8) & 0xFF));
+    pit_divisor = divisor;
+    pit_program(PIT_MODE_RATE_GENERATOR, divisor);
 
     pit_ticks = 0;
+    pit_residual = 0;
+    oneshot_count = 0;
 
     return E_OK;
 }
@@ -57,19 +153,116 @@ kerr_t pit_register(uint32_t frequency) {
     return driver_register(&pit_driver);
 }
 
-void pit_set_callback(pit_callback_t callback) {
-    tick_callback = callback;
-}
-
 uint64_t pit_get_ticks(void) {
     return pit_ticks;
 }
 
+uint64_t pit_get_interrupts(void) {
+    return pit_interrupts;
+}
+
+uint64_t pit_get_tickless_entries(void) {
+    return tickless_entries;
+}
+
+int pit_tickless_enter(uint64_t ticks) {
+    if (oneshot_count || tick_stopped || !pit_divisor) return 0;
+    if (ticks < 2) return 0;
+
+    // A tick waiting at the PIC would be taken for the end of the idle period
+    if (pit_irq_pending()) return 0;
+
+    if (lapic_available() && ktime_tsc_khz()) {
+        return pit_tickless_enter_lapic(ticks);
+    }
+
+    // Fallback: a mode 0 one-shot, as far as the 16-bit counter reaches
+    uint64_t max_ticks = 0xFFFF / pit_divisor;
+    if (ticks > max_ticks) ticks = max_ticks;
+    if (ticks < 2) return 0;
+
+    uint64_t saved_ticks = pit_ticks;
+    uint32_t saved_residual = pit_residual;
+
+    // Credit the part of the current period that has already passed
+    pit_account(pit_period_elapsed());
+
+    // Expire on a tick boundary
+    oneshot_count = (uint32_t)(ticks * pit_divisor - pit_residual);
+    pit_program(PIT_MODE_INTERRUPT_ON_TERMINAL_COUNT, oneshot_count);
+
+    // The period ended while switching over: undo, that interrupt is a plain tick
+    if (pit_irq_pending()) {
+        pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+        oneshot_count = 0;
+        pit_ticks = saved_ticks;
+        pit_residual = saved_residual;
+        return 0;
+    }
+
+    tickless_entries++;
+    return 1;
+}
+
+void pit_tickless_exit(void) {
+    if (tick_stopped) {
+        pit_tickless_exit_lapic();
+        return;
+    }
+    if (!oneshot_count) return;
+
+    // Read-back latches the count and the OUT pin together
+    outb(PIT_COMMAND, PIT_READBACK_CH0);
+    uint8_t status = inb(PIT_CHANNEL0);
+    uint32_t remaining = inb(PIT_CHANNEL0);
+    remaining |= (uint32_t)inb(PIT_CHANNEL0) << 8;
+
+    // Already expired: the pending interrupt does the accounting
+    if (status & PIT_STATUS_OUT) return;
+    if ((status & PIT_STATUS_NULL_COUNT) || remaining > oneshot_count) {
+        remaining = oneshot_count;
+    }
+
+    pit_account(oneshot_count - remaining);
+    oneshot_count = 0;
+    pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+}
+
+void pit_wait_ms(uint32_t ms) {
+    if (ms > PIT_MAX_WAIT_MS) ms = PIT_MAX_WAIT_MS;
+    uint32_t count = PIT_FREQUENCY / 1000 * ms;
+
+    // Gate channel 2 on with the speaker disconnected
+    uint8_t port_b = inb(PIT_PORT_B);
+    outb(PIT_PORT_B, (port_b & ~PIT_PORT_B_SPEAKER) | PIT_PORT_B_GATE2);
+
+    // Mode 0: OUT2 goes high once the count runs out
+    outb(PIT_COMMAND, PIT_CHANNEL_2 | PIT_ACCESS_LOHIBYTE | PIT_MODE_INTERRUPT_ON_TERMINAL_COUNT);
+    outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)((count >> 8) & 0xFF));
+
+    while (!(inb(PIT_PORT_B) & PIT_PORT_B_OUT2)) {
+        asm volatile("pause");
+    }
+
+    outb(PIT_PORT_B, port_b);
+}
+
 void pit_handler(void) {
-    pit_ticks++;
-    scheduler_tick();
+    pit_interrupts++;
 
-    if (tick_callback) {
-        tick_callback();
+    if (oneshot_count) {
+        // End of a tickless period: credit it and restart the periodic tick
+        pit_account(oneshot_count);
+        oneshot_count = 0;
+        pit_program(PIT_MODE_RATE_GENERATOR, pit_divisor);
+    } else {
+        pit_ticks++;
     }
+
+    ktime_tick();
+
+    // Wake the hrtimer softirq before the scheduler picks what runs next
+    hrtimer_interrupt();
+    scheduler_tick();
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "error_handling/errno.h"
 
 #define PIT_FREQUENCY 1193182  // Base frequency of PIT in Hz
+#define PIT_TICK_HZ 100        // Scheduler tick rate
 #define PIT_CHANNEL0 0x40
 #define PIT_CHANNEL1 0x41
 #define PIT_CHANNEL2 0x42
@@ -29,11 +30,45 @@
 #define PIT_CHANNEL_1 0x40
 #define PIT_CHANNEL_2 0x80
 
-typedef void (*pit_callback_t)(void);
+// Port 0x61 bits for channel 2
+#define PIT_PORT_B 0x61
+#define PIT_PORT_B_GATE2 0x01
+#define PIT_PORT_B_SPEAKER 0x02
+#define PIT_PORT_B_OUT2 0x20
+
+// Longest pit_wait_ms() the 16-bit channel 2 counter allows
+#define PIT_MAX_WAIT_MS 54
+
+// Read-back command latching count and status of channel 0, and the status bits
+#define PIT_READBACK_CH0 0xC2
+#define PIT_STATUS_OUT 0x80
+#define PIT_STATUS_NULL_COUNT 0x40
 
 kerr_t pit_register(uint32_t frequency);
-void pit_set_callback(pit_callback_t callback);
 uint64_t pit_get_ticks(void);
 void pit_handler(void);
 
+// Longest tickless idle period with a LAPIC, so the TSC clock still gets
+// rebased about once a second
+#define PIT_TICKLESS_MAX_TICKS PIT_TICK_HZ
+
+// Tickless idle. pit_tickless_enter() stops the periodic tick until up to
+// ticks ticks from now and returns 1, or returns 0 if the tick keeps running.
+// With a LAPIC timer and a TSC clock an hrtimer ends the idle period (at most
+// PIT_TICKLESS_MAX_TICKS). Otherwise a PIT one-shot does, which the 16-bit
+// counter caps at 5 ticks at 100Hz. pit_tickless_exit() credits the time that
+// passed and restarts the periodic tick, whichever interrupt ended the idle
+// period. Both must be called with interrupts disabled.
+int pit_tickless_enter(uint64_t ticks);
+void pit_tickless_exit(void);
+
+// Busy-wait ms milliseconds (at most PIT_MAX_WAIT_MS) on channel 2, with the
+// speaker off. Channel 0 and the tick are left alone, so other clocks can be
+// calibrated against this while interrupts are disabled.
+void pit_wait_ms(uint32_t ms);
+
+// Timer interrupts taken, and how often the tick was stopped
+uint64_t pit_get_interrupts(void);
+uint64_t pit_get_tickless_entries(void);
+
 #endif
\ No newline at end of file
@@ -4,8 +4,11 @@ global idt_load
 global irq0
 global irq1
 global irq_default
+global irq_lapic_timer
+global irq_spurious
 extern keyboard_handler
 extern pit_handler
+extern lapic_timer_handler
 
 idt_load:
     lidt [rdi]          ; First argument in rdi (64-bit calling convention)
@@ -129,6 +132,47 @@ irq1:
     pop rax
     iretq               ; 64-bit interrupt return
 
+; Local APIC timer interrupt (EOI is sent to the LAPIC by the handler)
+irq_lapic_timer:
+    push rax
+    push rcx
+    push rdx
+    push rbx
+    push rbp
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    call lapic_timer_handler
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rbp
+    pop rbx
+    pop rdx
+    pop rcx
+    pop rax
+    iretq
+
+; Local APIC spurious interrupt: no EOI, nothing to do
+irq_spurious:
+    iretq
+
 global irq_page_fault
 extern page_fault_handler
 
@@ -5,6 +5,7 @@
 #include "interrupts/idt.h"
 #include "drivers/keyboard.h"
 #include "drivers/pit.h"
+#include "drivers/lapic.h"
 #include "drivers/block.h"
 #include "drivers/disks/ata.h"
 #include "shell/shell.h"
@@ -19,7 +20,14 @@
 #include "fs/filesystems/ramfs.h"
 #include "mm/pmm.h"
 #include "mm/vmm.h"
+#include "mm/page.h"
+#include "mm/vmalloc.h"
+#include "mm/kstack.h"
+#include "mm/zeropool.h"
 #include "scheduler/task.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
+#include "boot/multiboot2.h"
 
 // Define heap area - 1MB heap starting at 2MB
 #define HEAP_START 0x200000
@@ -37,7 +45,7 @@ void shell_task_entry(void) {
     task_exit();
 }
 
-void kernel_main() {
+void kernel_main(uint64_t multiboot_info, uint64_t multiboot_magic) {
     //init serial first for debugging things later
     kerr_t serial_status = serial_init(COM1);
 
@@ -68,17 +76,26 @@ void kernel_main() {
     uint8_t err_count = 0;
     kerr_t status;
 
+    // Copy the memory map out of the boot info before anything can overwrite it
+    TRY_INIT("Multiboot2", multiboot2_parse(multiboot_info, multiboot_magic), err_count)
+
     // Initialize interrupts
     TRY_INIT("IDT", idt_register(), err_count)
 
     TRY_INIT("Memory", memory_init(PHYS_HEAP_START, PHYS_HEAP_SIZE),err_count)
 
-    TRY_INIT("PMM", pmm_init(), err_count)
+    // VMM first: it extends the direct map so the PMM can manage all of RAM
     TRY_INIT("VMM", vmm_init(), err_count)
+    TRY_INIT("PMM", pmm_init(), err_count)
+
+    TRY_INIT("Page Array", page_array_init(), err_count)
 
-    buddy_allocator_t* buddy = kalloc_pages(1);
-    TRY_INIT("Buddy Alloc",buddy_init(buddy, 0x04000000, 0x04000000),err_count)  // 64MB
+    // Hand every free page over to the DMA32/normal buddy zones
+    TRY_INIT("Buddy Alloc",buddy_init_zones(),err_count)
     TRY_INIT("Slab Alloc",slab_init(),err_count)
+    TRY_INIT("Zero Pool",zero_pool_init(),err_count)
+    TRY_INIT("vmalloc",vmalloc_init(),err_count)
+    TRY_INIT("Kernel Stacks",kstack_init(),err_count)
 
     // Initialize VFS layer
     TRY_INIT("VFS Layer", vfs_init(), err_count)
@@ -105,7 +122,11 @@ void kernel_main() {
     //Initialize drivers
     TRY_INIT("Keyboard", keyboard_register(), err_count)
 
-    TRY_INIT("PIT", pit_register(100), err_count)
+    TRY_INIT("Clocksource", ktime_init(), err_count)
+
+    TRY_INIT("PIT", pit_register(PIT_TICK_HZ), err_count)
+
+    TRY_INIT("LAPIC", lapic_register(), err_count)
 
     TRY_INIT("Block Device Layer",block_register(),err_count)
 
@@ -131,10 +152,13 @@ void kernel_main() {
     // Initialize task system BEFORE enabling interrupts
     TRY_INIT("Task System", task_init(), err_count)
     TRY_INIT("Scheduler", scheduler_init(), err_count)
+    TRY_INIT("hrtimer", hrtimer_init(), err_count)
 
     // Create shell task
     task_t* shell_task = task_create("shell", shell_task_entry);
     if (shell_task) {
+        // Interactive: run ahead of batch work at the default nice value
+        task_set_nice(shell_task, -5);
         scheduler_add_task(shell_task);
         serial_debug_puts("Shell task created and added to scheduler\n");
         console_puts("Shell task created\n");
@@ -151,8 +175,6 @@ void kernel_main() {
     serial_debug_puts("Kernel initialization complete, entering idle loop\n");
     console_puts("\nKernel running. Type 'help' for commands.\n\n");
 
-    // Kernel becomes the idle task - just halt and wait for interrupts
-    while(1) {
-        asm volatile("hlt");
-    }
+    // Kernel becomes the idle task: zero frames, then halt until needed
+    scheduler_idle_loop();
 }
\ No newline at end of file
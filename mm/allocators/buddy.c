@@ -1,10 +1,16 @@
 #include "buddy.h"
+#include "mm/pmm.h"
+#include "mm/page.h"
+#include "mm/shrinker.h"
+#include "mm/zeropool.h"
+#include "cpu/cpu.h"
 #include "console/console.h"
 #include "io/serial.h"
 #include "libc/string.h"
 
-//Global buddy allocator instance
-static buddy_allocator_t* g_buddy_allocator = NULL;
+//Zone allocators, filled in by buddy_init_zones()
+static buddy_allocator_t zones[BUDDY_ZONE_COUNT];
+static const char* zone_names[BUDDY_ZONE_COUNT] = { "DMA32", "Normal" };
 
 //Helper: get index from block address
 static inline uint64_t addr_to_block_index(buddy_allocator_t* alloc, uint64_t addr) {
@@ -38,14 +44,25 @@ static inline int bitmap_test(uint8_t* bitmap, uint64_t bit) {
     return bitmap[bit / 8] & (1 << (bit % 8));
 }
 
+// Helper: Is the block at 'index' the head of a free block of exactly 'order'
+static inline int is_free_head(buddy_allocator_t* alloc, uint64_t index, uint8_t order) {
+    return alloc->order_bitmap[index] == (BUDDY_PAGE_FREE | order);
+}
+
+// The free-head marker is kept in sync with the lists: it is set exactly
+// while a block sits on free_lists[order], so merging never has to search
 static void remove_from_free_list(buddy_allocator_t* alloc, buddy_block_t* block, uint8_t order) {
     if (block->prev) block->prev->next = block->next;
     else alloc->free_lists[order] = block->next;
 
     if (block->next) block->next->prev = block->prev;
+    else alloc->free_tails[order] = block->prev;
 
     block->next = NULL;
     block->prev = NULL;
+
+    uint64_t index = addr_to_block_index(alloc, VIRT_TO_PHYS((uint64_t)block));
+    alloc->order_bitmap[index] = order;
 }
 
 // Add block to free list
@@ -57,9 +74,29 @@ static void add_to_free_list(buddy_allocator_t* alloc, uint64_t addr, uint8_t or
 
     if (alloc->free_lists[order]) {
         alloc->free_lists[order]->prev = block;
+    } else {
+        alloc->free_tails[order] = block;
     }
 
     alloc->free_lists[order] = block;
+    alloc->order_bitmap[addr_to_block_index(alloc, addr)] = BUDDY_PAGE_FREE | order;
+}
+
+// Add block to the end of its free list, so it is the last one handed out
+static void add_to_free_list_tail(buddy_allocator_t* alloc, uint64_t addr, uint8_t order) {
+    buddy_block_t* block = (buddy_block_t*)PHYS_TO_VIRT(addr);
+
+    block->next = NULL;
+    block->prev = alloc->free_tails[order];
+
+    if (alloc->free_tails[order]) {
+        alloc->free_tails[order]->next = block;
+    } else {
+        alloc->free_lists[order] = block;
+    }
+
+    alloc->free_tails[order] = block;
+    alloc->order_bitmap[addr_to_block_index(alloc, addr)] = BUDDY_PAGE_FREE | order;
 }
 
 // Split a block into two smaller blocks
@@ -87,82 +124,69 @@ static kerr_t split_block(buddy_allocator_t* alloc, uint8_t order) {
     uint64_t buddy1_addr = block_addr;
     uint64_t buddy2_addr = block_addr + BUDDY_SIZE_FOR_ORDER(order);
 
-    // Add both to free list of smaller order
-    add_to_free_list(alloc, buddy1_addr, order);
+    // Add both to free list of smaller order, lower half on top so it is
+    // handed out first and its free upper buddy is there for in-place growth
     add_to_free_list(alloc, buddy2_addr, order);
+    add_to_free_list(alloc, buddy1_addr, order);
 
     alloc->splits++;
 
     return E_OK;
 }
 
-// Try to merge block with its buddy
-static void try_merge(buddy_allocator_t* alloc, uint64_t addr, uint8_t order) {
-    if (order >= BUDDY_MAX_ORDER) {
-        return;
-    }
-
-    uint64_t buddy_addr = get_buddy_addr(alloc, addr, order);
+// Coalesce a free block with its buddies as far as possible, then list it
+// The buddy's head byte says in O(1) whether it is free at the same order
+static void free_block(buddy_allocator_t* alloc, uint64_t addr, uint8_t order) {
+    while (order < BUDDY_MAX_ORDER) {
+        uint64_t buddy_addr = get_buddy_addr(alloc, addr, order);
 
-    // Check if buddy is in range
-    if (buddy_addr < alloc->base_addr ||
-        buddy_addr >= alloc->base_addr + alloc->total_size) {
-        return;
-    }
-
-    // Check if buddy is free
-    uint64_t buddy_index = addr_to_block_index(alloc, buddy_addr);
-    if (bitmap_test(alloc->allocation_bitmap, buddy_index)) {
-        return; // Buddy is allocated
-    }
-
-    // Find buddy in free list
-    buddy_block_t* buddy = alloc->free_lists[order];
-    buddy_block_t* buddy_virt = (buddy_block_t*)PHYS_TO_VIRT(buddy_addr);
-
-    while (buddy) {
-        if (buddy == buddy_virt) {
-            // Found buddy in free list - merge!
-            remove_from_free_list(alloc, buddy, order);
-
-            // Remove current block from free list
-            buddy_block_t* current = (buddy_block_t*)PHYS_TO_VIRT(addr);
-            remove_from_free_list(alloc, current, order);
-
-            // Merged block starts at lower address
-            uint64_t merged_addr = (addr < buddy_addr) ? addr : buddy_addr;
-
-            // Add merged block to next order
-            add_to_free_list(alloc, merged_addr, order + 1);
+        // Check if buddy is in range
+        if (buddy_addr < alloc->base_addr ||
+            buddy_addr >= alloc->base_addr + alloc->total_size) {
+            break;
+        }
 
-            alloc->merges++;
+        // Buddy must be a whole free block of the same order
+        if (!is_free_head(alloc, addr_to_block_index(alloc, buddy_addr), order)) {
+            break;
+        }
 
-            // Recursively try to merge at higher order
-            try_merge(alloc, merged_addr, order + 1);
+        remove_from_free_list(alloc, (buddy_block_t*)PHYS_TO_VIRT(buddy_addr), order);
 
-            return;
+        // Merged block starts at lower address
+        if (buddy_addr < addr) {
+            addr = buddy_addr;
         }
-        buddy = buddy->next;
-    }
-}
+        order++;
 
-kerr_t buddy_init(buddy_allocator_t* allocator, uint64_t base_addr, uint64_t size) {
-    if (!allocator || !IS_PAGE_ALIGNED(base_addr) || !IS_PAGE_ALIGNED(size)) {
-        return E_NOMEM;
+        alloc->merges++;
     }
 
-    // Size must be power of 2
-    if ((size & (size - 1)) != 0) {
+    add_to_free_list(alloc, addr, order);
+}
+
+kerr_t buddy_init(buddy_allocator_t* allocator, const char* name, uint64_t base_addr, uint64_t size) {
+    if (!allocator || !IS_PAGE_ALIGNED(base_addr) || !IS_PAGE_ALIGNED(size) || size == 0) {
         return E_INVALID;
     }
 
-    allocator->base_addr = base_addr;
-    allocator->total_size = size;
-    allocator->total_pages = size / PAGE_SIZE;
+    // Start the span on a max-order boundary so buddy addresses line up with
+    // physical alignment. Pages below base_addr simply stay reserved.
+    uint64_t max_block = BUDDY_SIZE_FOR_ORDER(BUDDY_MAX_ORDER);
+    uint64_t span_start = base_addr & ~(max_block - 1);
+    uint64_t span_end = base_addr + size;
+
+    allocator->name = name;
+    allocator->base_addr = span_start;
+    allocator->total_size = span_end - span_start;
+    allocator->total_pages = allocator->total_size / PAGE_SIZE;
+    allocator->managed_pages = 0;
+    allocator->free_pages = 0;
 
     // Initialize free lists
     for (int i = 0; i <= BUDDY_MAX_ORDER; i++) {
         allocator->free_lists[i] = NULL;
+        allocator->free_tails[i] = NULL;
         allocator->allocations[i] = 0;
         allocator->deallocations[i] = 0;
     }
@@ -173,44 +197,102 @@ kerr_t buddy_init(buddy_allocator_t* allocator, uint64_t base_addr, uint64_t siz
     // Calculate bitmap sizes
     size_t alloc_bitmap_size = (allocator->total_pages + 7) / 8;  // 1 bit per page
     size_t order_bitmap_size = allocator->total_pages;             // 1 byte per page
+    size_t bitmap_pages = (alloc_bitmap_size + order_bitmap_size + PAGE_SIZE - 1) / PAGE_SIZE;
 
-    // Allocate both bitmaps at start of managed region
-    allocator->allocation_bitmap = (uint8_t*)PHYS_TO_VIRT(base_addr);
+    // Metadata lives outside the managed memory so any span size works
+    uint64_t bitmap_phys = pmm_alloc_pages(bitmap_pages);
+    if (!bitmap_phys) {
+        serial_debug_puts("[BUDDY] No memory for zone metadata\n");
+        return E_NOMEM;
+    }
+
+    allocator->allocation_bitmap = (uint8_t*)PHYS_TO_VIRT(bitmap_phys);
     allocator->order_bitmap = allocator->allocation_bitmap + alloc_bitmap_size;
 
-    memset(allocator->allocation_bitmap, 0, alloc_bitmap_size);
-    memset(allocator->order_bitmap, 0, order_bitmap_size);
+    // Everything is reserved until donated with buddy_add_range()
+    memset(allocator->allocation_bitmap, 0xFF, alloc_bitmap_size);
+    memset(allocator->order_bitmap, BUDDY_ORDER_RESERVED, order_bitmap_size);
+
+    return E_OK;
+}
+
+void buddy_add_range(buddy_allocator_t* allocator, uint64_t start, uint64_t end) {
+    if (!allocator) return;
+
+    start = PAGE_ALIGN_UP(start);
+    end = PAGE_ALIGN_DOWN(end);
+    if (start < allocator->base_addr) start = allocator->base_addr;
+    if (end > allocator->base_addr + allocator->total_size) end = allocator->base_addr + allocator->total_size;
+
+    // Carve the range into the largest naturally aligned blocks that fit
+    while (start < end) {
+        uint64_t index = addr_to_block_index(allocator, start);
+        uint8_t order = BUDDY_MAX_ORDER;
+        while (order > 0 &&
+               ((index & (BUDDY_PAGES_PER_ORDER(order) - 1)) != 0 ||
+                start + BUDDY_SIZE_FOR_ORDER(order) > end)) {
+            order--;
+        }
+
+        uint64_t num_pages = BUDDY_PAGES_PER_ORDER(order);
+        for (uint64_t i = 0; i < num_pages; i++) {
+            bitmap_clear(allocator->allocation_bitmap, index + i);
+            allocator->order_bitmap[index + i] = 0;
+        }
+
+        allocator->managed_pages += num_pages;
+        allocator->free_pages += num_pages;
+
+        free_block(allocator, start, order);
+
+        start += BUDDY_SIZE_FOR_ORDER(order);
+    }
+}
 
-    // Mark bitmap pages as used
-    size_t total_bitmap_size = alloc_bitmap_size + order_bitmap_size;
-    size_t bitmap_pages = (total_bitmap_size + PAGE_SIZE - 1) / PAGE_SIZE;
+kerr_t buddy_init_zones(void) {
+    uint64_t memory_end = pmm_get_memory_end();
+    uint64_t zone_start[BUDDY_ZONE_COUNT] = { PHYS_FREE_START, BUDDY_ZONE_DMA32_END };
+    uint64_t zone_end[BUDDY_ZONE_COUNT] = { BUDDY_ZONE_DMA32_END, memory_end };
 
-    // Add remaining memory to largest possible orders
-    uint64_t current_addr = base_addr + (bitmap_pages * PAGE_SIZE);
-    uint64_t remaining_size = size - (bitmap_pages * PAGE_SIZE);
+    //Allocate all zone metadata while the PMM bitmap is still the allocator
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        zones[z].total_pages = 0;
+        if (zone_end[z] > memory_end) zone_end[z] = memory_end;
+        if (zone_start[z] >= zone_end[z]) continue;
 
-    // Add blocks in descending order of size
-    for (int order = BUDDY_MAX_ORDER; order >= 0; order--) {
-        size_t block_size = BUDDY_SIZE_FOR_ORDER(order);
+        kerr_t err = buddy_init(&zones[z], zone_names[z], zone_start[z], zone_end[z] - zone_start[z]);
+        if (err != E_OK) return err;
+    }
 
-        while (remaining_size >= block_size) {
-            add_to_free_list(allocator, current_addr, order);
-            current_addr += block_size;
-            remaining_size -= block_size;
+    //Move every page the PMM still has free into the zone that owns it
+    uint64_t range_end = 0;
+    uint64_t range_start = pmm_find_free_range(0, &range_end);
+    while (range_start) {
+        for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+            if (!zones[z].total_pages) continue;
+            uint64_t start = range_start > zone_start[z] ? range_start : zone_start[z];
+            uint64_t end = range_end < zone_end[z] ? range_end : zone_end[z];
+            if (start < end) buddy_add_range(&zones[z], start, end);
         }
+        range_start = pmm_find_free_range(range_end, &range_end);
     }
 
-    // Set global allocator
-    g_buddy_allocator = allocator;
+    pmm_handoff();
 
-    serial_debug_puts("[BUDDY] Initialized at 0x");
-    char addr_str[32];
-    uitoa(base_addr, addr_str);
-    serial_debug_puts(addr_str);
-    serial_debug_puts(" with ");
-    uitoa(size / 1024 / 1024, addr_str);
-    serial_debug_puts(addr_str);
-    serial_debug_puts(" MB\n");
+    char num_str[32];
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        if (!zones[z].total_pages) continue;
+        serial_debug_puts("[BUDDY] Zone ");
+        serial_debug_puts(zones[z].name);
+        serial_debug_puts(": 0x");
+        serial_puthex(COM1, zones[z].base_addr, 16);
+        serial_debug_puts(" - 0x");
+        serial_puthex(COM1, zones[z].base_addr + zones[z].total_size, 16);
+        serial_debug_puts(", ");
+        uitoa(zones[z].managed_pages * PAGE_SIZE / 1024 / 1024, num_str);
+        serial_debug_puts(num_str);
+        serial_debug_puts(" MB managed\n");
+    }
 
     return E_OK;
 }
@@ -233,7 +315,10 @@ size_t buddy_get_actual_size(size_t size) {
     return BUDDY_SIZE_FOR_ORDER(order);
 }
 
-uint64_t buddy_alloc_order(buddy_allocator_t* allocator, uint8_t order) {
+// The free lists are shared with interrupt handlers and with whatever task
+// preempts the idle task's pool refill, so every entry point that touches
+// them runs with interrupts off. The unlocked bodies below do the work.
+static uint64_t alloc_order_locked(buddy_allocator_t* allocator, uint8_t order) {
     if (!allocator || order > BUDDY_MAX_ORDER) {
         return 0;
     }
@@ -265,21 +350,35 @@ uint64_t buddy_alloc_order(buddy_allocator_t* allocator, uint8_t order) {
         allocator->order_bitmap[block_index + i] = order;  // Store order
     }
 
+    page_t* page = phys_to_page(addr);
+    if (page) {
+        page->owner = PAGE_OWNER_BUDDY;
+        page->order = order;
+    }
+
     allocator->allocations[order]++;
+    allocator->free_pages -= num_pages;
 
     return addr;
 }
 
+uint64_t buddy_alloc_order(buddy_allocator_t* allocator, uint8_t order) {
+    uint64_t flags = irq_save();
+    uint64_t addr = alloc_order_locked(allocator, order);
+    irq_restore(flags);
+    return addr;
+}
+
 uint64_t buddy_alloc(buddy_allocator_t* allocator, size_t size) {
     uint8_t order = buddy_get_order_for_size(size);
     return buddy_alloc_order(allocator, order);
 }
 
-void buddy_free(buddy_allocator_t* allocator, uint64_t phys_addr) {
+static void free_locked(buddy_allocator_t* allocator, uint64_t phys_addr) {
     if (!allocator || phys_addr < allocator->base_addr ||
         phys_addr >= allocator->base_addr + allocator->total_size) {
         return;
-        }
+    }
 
     if (!IS_PAGE_ALIGNED(phys_addr)) {
         serial_debug_puts("[BUDDY] Warning: Freeing non-aligned address\n");
@@ -298,6 +397,11 @@ void buddy_free(buddy_allocator_t* allocator, uint64_t phys_addr) {
 
     // Get the stored order
     uint8_t order = allocator->order_bitmap[block_index];
+    if (order == BUDDY_ORDER_RESERVED) {
+        // Page handed out by the PMM before the zones existed, adopt it
+        order = 0;
+        allocator->managed_pages++;
+    }
     size_t num_pages = BUDDY_PAGES_PER_ORDER(order);
 
     // Mark pages as free and clear order
@@ -306,13 +410,130 @@ void buddy_free(buddy_allocator_t* allocator, uint64_t phys_addr) {
         allocator->order_bitmap[block_index + i] = 0;
     }
 
+    page_t* page = phys_to_page(phys_addr);
+    if (page) page->owner = PAGE_OWNER_NONE;
+
     allocator->deallocations[order]++;
+    allocator->free_pages += num_pages;
 
-    // Add to free list
-    add_to_free_list(allocator, phys_addr, order);
+    // Merge with free buddies and put the result on its free list
+    free_block(allocator, phys_addr, order);
+}
 
-    // Try to merge with buddy
-    try_merge(allocator, phys_addr, order);
+void buddy_free(buddy_allocator_t* allocator, uint64_t phys_addr) {
+    uint64_t flags = irq_save();
+    free_locked(allocator, phys_addr);
+    irq_restore(flags);
+}
+
+static uint64_t alloc_pages(uint8_t order, uint32_t flags) {
+    do {
+        // Keep DMA32 memory for callers that need it while normal memory lasts
+        if (!(flags & BUDDY_FLAG_DMA32)) {
+            uint64_t addr = buddy_alloc_order(buddy_get_zone(BUDDY_ZONE_NORMAL), order);
+            if (addr) return addr;
+        }
+
+        uint64_t addr = buddy_alloc_order(buddy_get_zone(BUDDY_ZONE_DMA32), order);
+        if (addr) return addr;
+
+        // Out of memory: retry for as long as the shrinkers give pages back
+    } while (!(flags & BUDDY_FLAG_NO_RECLAIM) && shrink_all(BUDDY_PAGES_PER_ORDER(order)));
+
+    return 0;
+}
+
+uint64_t buddy_alloc_pages(uint8_t order, uint32_t flags) {
+    if (!(flags & BUDDY_FLAG_ZERO)) return alloc_pages(order, flags);
+
+    // Single zeroed pages come from the pool the idle task fills
+    if (order == 0 && !(flags & BUDDY_FLAG_DMA32)) {
+        uint64_t addr = zero_pool_get();
+        if (addr) return addr;
+    }
+
+    uint64_t addr = alloc_pages(order, flags);
+    if (addr) memset(PHYS_TO_VIRT(addr), 0, BUDDY_SIZE_FOR_ORDER(order));
+    return addr;
+}
+
+void buddy_free_pages(uint64_t phys_addr) {
+    buddy_allocator_t* zone = buddy_zone_of(phys_addr);
+    if (!zone) {
+        serial_debug_puts("[BUDDY] Warning: Freeing address outside all zones: 0x");
+        serial_puthex(COM1, phys_addr, 16);
+        serial_debug_puts("\n");
+        return;
+    }
+
+    buddy_free(zone, phys_addr);
+}
+
+static kerr_t resize_locked(uint64_t phys_addr, uint8_t new_order) {
+    buddy_allocator_t* alloc = buddy_zone_of(phys_addr);
+    if (!alloc || new_order > BUDDY_MAX_ORDER || !IS_PAGE_ALIGNED(phys_addr)) {
+        return E_INVALID;
+    }
+
+    uint64_t index = addr_to_block_index(alloc, phys_addr);
+    if (!bitmap_test(alloc->allocation_bitmap, index)) return E_INVALID;
+
+    uint8_t order = alloc->order_bitmap[index];
+    if (order == BUDDY_ORDER_RESERVED) return E_INVALID;
+    if (order == new_order) return E_OK;
+
+    if (new_order > order) {
+        // Every buddy up to new_order must be a free block right above us
+        for (uint8_t k = order; k < new_order; k++) {
+            uint64_t buddy_index = index + BUDDY_PAGES_PER_ORDER(k);
+            if ((index & (BUDDY_PAGES_PER_ORDER(k + 1) - 1)) != 0 ||
+                buddy_index >= alloc->total_pages ||
+                !is_free_head(alloc, buddy_index, k)) {
+                return E_NOMEM;
+            }
+        }
+
+        for (uint8_t k = order; k < new_order; k++) {
+            uint64_t buddy_index = index + BUDDY_PAGES_PER_ORDER(k);
+            remove_from_free_list(alloc, (buddy_block_t*)PHYS_TO_VIRT(index_to_addr(alloc, buddy_index)), k);
+            for (uint64_t i = 0; i < BUDDY_PAGES_PER_ORDER(k); i++) {
+                bitmap_set(alloc->allocation_bitmap, buddy_index + i);
+            }
+            alloc->free_pages -= BUDDY_PAGES_PER_ORDER(k);
+        }
+    } else {
+        // Free the upper halves, largest first; each one's buddy is the part we keep.
+        // They go to the back of the lists so other allocations take them last
+        // and a later grow of this block can usually absorb them again.
+        for (uint8_t k = order; k > new_order; k--) {
+            uint64_t tail_index = index + BUDDY_PAGES_PER_ORDER(k - 1);
+            for (uint64_t i = 0; i < BUDDY_PAGES_PER_ORDER(k - 1); i++) {
+                bitmap_clear(alloc->allocation_bitmap, tail_index + i);
+                alloc->order_bitmap[tail_index + i] = 0;
+            }
+            alloc->free_pages += BUDDY_PAGES_PER_ORDER(k - 1);
+            add_to_free_list_tail(alloc, index_to_addr(alloc, tail_index), k - 1);
+        }
+    }
+
+    for (uint64_t i = 0; i < BUDDY_PAGES_PER_ORDER(new_order); i++) {
+        alloc->order_bitmap[index + i] = new_order;
+    }
+
+    page_t* page = phys_to_page(phys_addr);
+    if (page) page->order = new_order;
+
+    alloc->deallocations[order]++;
+    alloc->allocations[new_order]++;
+
+    return E_OK;
+}
+
+kerr_t buddy_resize_pages(uint64_t phys_addr, uint8_t new_order) {
+    uint64_t flags = irq_save();
+    kerr_t err = resize_locked(phys_addr, new_order);
+    irq_restore(flags);
+    return err;
 }
 
 int buddy_is_allocated(buddy_allocator_t* allocator, uint64_t phys_addr) {
@@ -327,37 +548,33 @@ int buddy_is_allocated(buddy_allocator_t* allocator, uint64_t phys_addr) {
 
 uint64_t buddy_get_free_memory(buddy_allocator_t* allocator) {
     if (!allocator) return 0;
-
-    uint64_t free_mem = 0;
-    for (int order = 0; order <= BUDDY_MAX_ORDER; order++) {
-        buddy_block_t* block = allocator->free_lists[order];
-        int count = 0;
-
-        while (block) {
-            count++;
-            block = block->next;
-        }
-
-        free_mem += count * BUDDY_SIZE_FOR_ORDER(order);
-    }
-
-    return free_mem;
+    return allocator->free_pages * PAGE_SIZE;
 }
 
 uint64_t buddy_get_used_memory(buddy_allocator_t* allocator) {
     if (!allocator) return 0;
-    return allocator->total_size - buddy_get_free_memory(allocator);
+    return (allocator->managed_pages - allocator->free_pages) * PAGE_SIZE;
 }
 
 void buddy_print_stats(buddy_allocator_t* allocator) {
     if (!allocator) return;
 
-    console_puts("\n=== Buddy Allocator Statistics ===\n");
+    console_puts("\n=== Buddy Zone ");
+    console_puts(allocator->name);
+    console_puts(" ===\n");
 
     char num_str[32];
 
+    console_puts("Span:         ");
+    uitoa(allocator->base_addr / 1024 / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" MB - ");
+    uitoa((allocator->base_addr + allocator->total_size) / 1024 / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" MB\n");
+
     console_puts("Total memory: ");
-    uitoa(allocator->total_size / 1024 / 1024, num_str);
+    uitoa(allocator->managed_pages * PAGE_SIZE / 1024 / 1024, num_str);
     console_puts(num_str);
     console_puts(" MB\n");
 
@@ -406,6 +623,40 @@ void buddy_print_stats(buddy_allocator_t* allocator) {
     console_putc('\n');
 }
 
-buddy_allocator_t* buddy_get_global(void) {
-    return g_buddy_allocator;
+uint64_t buddy_get_total_free_memory(void) {
+    uint64_t total = 0;
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        total += buddy_get_free_memory(buddy_get_zone(z));
+    }
+    return total;
+}
+
+uint64_t buddy_get_total_used_memory(void) {
+    uint64_t total = 0;
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        total += buddy_get_used_memory(buddy_get_zone(z));
+    }
+    return total;
+}
+
+void buddy_print_all_stats(void) {
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        buddy_print_stats(buddy_get_zone(z));
+    }
+}
+
+buddy_allocator_t* buddy_get_zone(buddy_zone_t zone) {
+    if (zone >= BUDDY_ZONE_COUNT || !zones[zone].total_pages) return NULL;
+    return &zones[zone];
+}
+
+buddy_allocator_t* buddy_zone_of(uint64_t phys_addr) {
+    for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
+        buddy_allocator_t* zone = buddy_get_zone(z);
+        if (zone && phys_addr >= zone->base_addr &&
+            phys_addr < zone->base_addr + zone->total_size) {
+            return zone;
+        }
+    }
+    return NULL;
 }
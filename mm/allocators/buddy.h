@@ -18,19 +18,45 @@
 // Calculate size in bytes for an order
 #define BUDDY_SIZE_FOR_ORDER(order) (PAGE_SIZE * BUDDY_PAGES_PER_ORDER(order))
 
+// Memory zones. Every usable page frame belongs to exactly one zone.
+typedef enum {
+    BUDDY_ZONE_DMA32 = 0,   // Below 4GB, reachable by 32-bit DMA engines
+    BUDDY_ZONE_NORMAL,      // Everything above 4GB
+    BUDDY_ZONE_COUNT
+} buddy_zone_t;
+
+#define BUDDY_ZONE_DMA32_END 0x100000000ULL
+
+// order_bitmap encoding, one byte per page:
+//   BUDDY_PAGE_FREE | order  head page of a block on free_lists[order]
+//   order                    page of an allocated block
+//   BUDDY_ORDER_RESERVED     never donated to the allocator (hole, or in use at handoff)
+#define BUDDY_PAGE_FREE      0x80
+#define BUDDY_ORDER_MASK     0x7F
+#define BUDDY_ORDER_RESERVED 0x7F
+
+// Allocation flags for buddy_alloc_pages()
+#define BUDDY_FLAG_DMA32 (1 << 0)   // Physical address must be below 4GB
+#define BUDDY_FLAG_NO_RECLAIM (1 << 1)  // Fail instead of running the shrinkers
+#define BUDDY_FLAG_ZERO (1 << 2)    // Zeroed memory (order 0 from the pre-zeroed pool)
+
 // Free list node (stored in free blocks)
 typedef struct buddy_block {
     struct buddy_block* next;
     struct buddy_block* prev;
 } buddy_block_t;
 
-// Buddy allocator struct
+// Buddy allocator struct (one per zone)
 typedef struct {
-    uint64_t base_addr;
-    uint64_t total_size;
+    const char* name;
+    uint64_t base_addr;     // Aligned down to a max-order block
+    uint64_t total_size;    // Span covered by the metadata, holes included
     uint64_t total_pages;
+    uint64_t managed_pages; // Pages actually handed to the allocator
+    uint64_t free_pages;
 
     buddy_block_t* free_lists[BUDDY_MAX_ORDER + 1];
+    buddy_block_t* free_tails[BUDDY_MAX_ORDER + 1];  // Last block, for tail inserts
 
     uint64_t allocations[BUDDY_MAX_ORDER + 1];
     uint64_t deallocations[BUDDY_MAX_ORDER + 1];
@@ -38,13 +64,20 @@ typedef struct {
     uint64_t merges;
 
     uint8_t* allocation_bitmap;
-    uint8_t* order_bitmap;  // NEW: Store order for each allocation
+    uint8_t* order_bitmap;  // Order and free-head marker for each page
 } buddy_allocator_t;
 
-// Initialize buddy allocator
-// base_addr: Physical address of memory region to manage
-// size: Size of region in bytes (must be power of 2)
-kerr_t buddy_init(buddy_allocator_t* allocator, uint64_t base_addr, uint64_t size);
+// Initialize an empty buddy allocator covering [base_addr, base_addr + size)
+// Any page-aligned size works. Metadata comes from the PMM and every page
+// starts out reserved until it is donated with buddy_add_range().
+kerr_t buddy_init(buddy_allocator_t* allocator, const char* name, uint64_t base_addr, uint64_t size);
+
+// Donate the free physical range [start, end) to the allocator
+void buddy_add_range(buddy_allocator_t* allocator, uint64_t start, uint64_t end);
+
+// Build the DMA32 and normal zones from every page the PMM still has free,
+// then switch the PMM over so all page allocations come from the zones
+kerr_t buddy_init_zones(void);
 
 // Allocate memory block of at least 'size' bytes
 // Returns physical address or 0 on failure
@@ -57,6 +90,18 @@ uint64_t buddy_alloc_order(buddy_allocator_t* allocator, uint8_t order);
 // Free memory block at physical address
 void buddy_free(buddy_allocator_t* allocator, uint64_t phys_addr);
 
+// Zone-aware allocation: tries the normal zone first and falls back to DMA32
+// (DMA32 only with BUDDY_FLAG_DMA32). Returns physical address or 0.
+uint64_t buddy_alloc_pages(uint8_t order, uint32_t flags);
+
+// Free a block from any zone
+void buddy_free_pages(uint64_t phys_addr);
+
+// Change the order of an allocated block without moving it. Growing absorbs
+// the free buddies above the block (E_NOMEM if one is in use or the block is
+// an upper half), shrinking gives the tail halves back.
+kerr_t buddy_resize_pages(uint64_t phys_addr, uint8_t new_order);
+
 // Get order for a given size
 uint8_t buddy_get_order_for_size(size_t size);
 
@@ -71,7 +116,15 @@ uint64_t buddy_get_free_memory(buddy_allocator_t* allocator);
 uint64_t buddy_get_used_memory(buddy_allocator_t* allocator);
 void buddy_print_stats(buddy_allocator_t* allocator);
 
-// Get global buddy allocator (initialized in buddy_init)
-buddy_allocator_t* buddy_get_global(void);
+// Totals across all zones
+uint64_t buddy_get_total_free_memory(void);
+uint64_t buddy_get_total_used_memory(void);
+void buddy_print_all_stats(void);
+
+// Get a zone (NULL if the zone has no memory or zones are not up yet)
+buddy_allocator_t* buddy_get_zone(buddy_zone_t zone);
+
+// Find the zone a physical address belongs to
+buddy_allocator_t* buddy_zone_of(uint64_t phys_addr);
 
-#endif
\ No newline at end of file
+#endif
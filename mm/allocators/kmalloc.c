@@ -3,98 +3,168 @@
 #include "buddy.h"
 #include "mm/pmm.h"
 #include "mm/memory_layout.h"
+#include "mm/page.h"
+#include "mm/shrinker.h"
+#include "io/serial.h"
 #include "console/console.h"
 #include "libc/string.h"
 
 /*
- * - Requests ≤ 4KB go to slab allocator
+ * - Requests ≤ 4KB go to the slab size classes (8, 16, 24, 32, 48, 64, 96, ...)
  * - Requests > 4KB go to buddy allocator (page-level allocation)
  * - Slab allocator uses buddy allocator internally for getting pages
+ * - The page descriptor of a pointer says which allocator owns it, so
+ *   kfree/ksize never have to search or trust bytes in front of the pointer
  */
 
-// Magic number to identify buddy-allocated blocks
-// This helps kfree() determine which allocator was used
-#define BUDDY_MAGIC 0xB0DD1E5
+// ============================================================================
 
-// Header for buddy allocations (stored before returned pointer)
-typedef struct {
-    uint32_t magic;     // BUDDY_MAGIC
-    uint32_t order;     // Buddy order used
-    uint64_t size;      // Original requested size
-} buddy_alloc_header_t;
+// Small allocation bytes: requested, handed out by the size classes, and what
+// power-of-two classes from 32 bytes would have handed out. Cumulative totals
+// since boot: kfree() does not know the requested size, so they never shrink.
+static uint64_t small_requested_bytes = 0;
+static uint64_t small_class_bytes = 0;
+static uint64_t small_pow2_bytes = 0;
+
+static size_t pow2_class_size(size_t size) {
+    size_t class_size = 32;
+    while (class_size < size) {
+        class_size <<= 1;
+    }
+    return class_size;
+}
 
-//========================================================
+// Orders of free buddies krealloc leaves above a block it had to move
+#define KREALLOC_HEADROOM_ORDERS 2
 
-// Check if a pointer was allocated by buddy allocator
-static inline int is_buddy_allocation(void* ptr) {
-    if (!ptr) return 0;
+// Buddy-backed allocation. With headroom, carve the block from the start of a
+// larger one and free the rest, so krealloc can later grow into it in place.
+// flags go to the buddy allocator (BUDDY_FLAG_ZERO for kcalloc).
+static void* kmalloc_large(size_t size, uint8_t headroom, uint32_t flags) {
+    if (size > BUDDY_SIZE_FOR_ORDER(BUDDY_MAX_ORDER)) return NULL;
+    uint8_t order = buddy_get_order_for_size(size);
 
-    buddy_alloc_header_t* header = (buddy_alloc_header_t*)((uint64_t)ptr - sizeof(buddy_alloc_header_t));
-    return header->magic == BUDDY_MAGIC;
-}
+    if (order + headroom > BUDDY_MAX_ORDER) headroom = BUDDY_MAX_ORDER - order;
 
-// Get the order of a buddy allocation
-static inline uint32_t get_buddy_order(void* ptr) {
-    buddy_alloc_header_t* header = (buddy_alloc_header_t*)((uint64_t)ptr - sizeof(buddy_alloc_header_t));
-    return header->order;
-}
+    uint64_t phys = 0;
+    if (headroom) {
+        // Headroom is a bonus, not worth reclaiming memory for
+        phys = buddy_alloc_pages(order + headroom, BUDDY_FLAG_NO_RECLAIM | flags);
+        if (phys) buddy_resize_pages(phys, order);
+    }
+    if (!phys) phys = buddy_alloc_pages(order, flags);
+    if (!phys) return NULL;
 
-// Get the original size of a buddy allocation
-static inline uint64_t get_buddy_size(void* ptr) {
-    buddy_alloc_header_t* header = (buddy_alloc_header_t*)((uint64_t)ptr - sizeof(buddy_alloc_header_t));
-    return header->size;
-}
+    phys_to_page(phys)->owner = PAGE_OWNER_KMALLOC;
 
-// ============================================================================
+    return PHYS_TO_VIRT(phys);
+}
 
 void* kmalloc(size_t size) {
     if (size == 0) return NULL;
 
-    // Small allocations go to slab allocator
-    if (size <= 4096) {
-        return slab_kmalloc(size);
+    // Small allocations go to the slab size classes
+    if (size <= KMALLOC_MAX_CACHE_SIZE) {
+        slab_cache_t* cache = kmalloc_cache_for(size);
+        void* obj = slab_alloc(cache);
+        if (obj) {
+            small_requested_bytes += size;
+            small_class_bytes += cache->object_size;
+            small_pow2_bytes += pow2_class_size(size);
+        }
+        return obj;
     }
 
     // Large allocations go to buddy allocator
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return NULL;
+    return kmalloc_large(size, 0, 0);
+}
 
-    // We need extra space for header
-    size_t total_size = size + sizeof(buddy_alloc_header_t);
-    uint8_t order = buddy_get_order_for_size(total_size);
+void kfree(void* ptr) {
+    if (!ptr) return;
 
-    uint64_t phys = buddy_alloc_order(buddy, order);
-    if (!phys) return NULL;
+    page_t* page = virt_to_page(ptr);
+    if (!page) {
+        serial_debug_puts("[KMALLOC] Warning: kfree() of non direct-map pointer\n");
+        return;
+    }
+
+    switch (page->owner) {
+        case PAGE_OWNER_SLAB:
+            slab_free(page->cache, ptr);
+            break;
+        case PAGE_OWNER_KMALLOC:
+            buddy_free_pages(VIRT_TO_PHYS((uint64_t)ptr));
+            break;
+        default:
+            serial_debug_puts("[KMALLOC] Warning: kfree() of pointer not from kmalloc: 0x");
+            serial_puthex(COM1, (uint64_t)ptr, 16);
+            serial_debug_putc('\n');
+            break;
+    }
+}
 
-    void* virt = PHYS_TO_VIRT(phys);
+size_t ksize(const void* ptr) {
+    if (!ptr) return 0;
 
-    // Write header
-    buddy_alloc_header_t* header = (buddy_alloc_header_t*)virt;
-    header->magic = BUDDY_MAGIC;
-    header->order = order;
-    header->size = size;
+    page_t* page = virt_to_page(ptr);
+    if (!page) return 0;
 
-    // Return pointer after header
-    return (void*)((uint64_t)virt + sizeof(buddy_alloc_header_t));
+    switch (page->owner) {
+        case PAGE_OWNER_SLAB:
+            return page->cache->object_size;
+        case PAGE_OWNER_KMALLOC:
+            return BUDDY_SIZE_FOR_ORDER(page->order);
+        default:
+            return 0;
+    }
 }
 
-void kfree(void* ptr) {
-    if (!ptr) return;
+uint32_t kmalloc_bulk(size_t size, uint32_t count, void** ptrs) {
+    if (size == 0 || count == 0 || !ptrs) return 0;
 
-    // Check if this was a buddy allocation
-    if (is_buddy_allocation(ptr)) {
-        // Free via buddy allocator
-        buddy_allocator_t* buddy = buddy_get_global();
-        if (!buddy) return;
+    // One batch from the size class cache
+    if (size <= KMALLOC_MAX_CACHE_SIZE) {
+        slab_cache_t* cache = kmalloc_cache_for(size);
+        if (!slab_alloc_bulk(cache, count, ptrs)) return 0;
 
-        // Get the actual allocation start (before header)
-        void* alloc_start = (void*)((uint64_t)ptr - sizeof(buddy_alloc_header_t));
-        uint64_t phys = VIRT_TO_PHYS((uint64_t)alloc_start);
+        small_requested_bytes += (uint64_t)size * count;
+        small_class_bytes += (uint64_t)cache->object_size * count;
+        small_pow2_bytes += (uint64_t)pow2_class_size(size) * count;
+        return count;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        ptrs[i] = kmalloc(size);
+        if (!ptrs[i]) {
+            kfree_bulk(i, ptrs);
+            return 0;
+        }
+    }
+
+    return count;
+}
 
-        buddy_free(buddy, phys);
-    } else {
-        // Try slab allocator
-        slab_kfree(ptr);
+void kfree_bulk(uint32_t count, void** ptrs) {
+    if (!ptrs) return;
+
+    uint32_t i = 0;
+    while (i < count) {
+        page_t* page = ptrs[i] ? virt_to_page(ptrs[i]) : NULL;
+        if (!page || page->owner != PAGE_OWNER_SLAB) {
+            kfree(ptrs[i++]);
+            continue;
+        }
+
+        // Hand each run of same-cache objects to the slab in one call
+        uint32_t run = 1;
+        while (i + run < count && ptrs[i + run]) {
+            page_t* next = virt_to_page(ptrs[i + run]);
+            if (!next || next->owner != PAGE_OWNER_SLAB || next->cache != page->cache) break;
+            run++;
+        }
+
+        slab_free_bulk(page->cache, run, ptrs + i);
+        i += run;
     }
 }
 
@@ -106,6 +176,12 @@ void* kcalloc(size_t num, size_t size) {
         return NULL;
     }
 
+    // Page-sized and up: let the buddy allocator zero it, so a single page
+    // comes straight from the pre-zeroed pool
+    if (total >= PAGE_SIZE) {
+        return kmalloc_large(total, 0, BUDDY_FLAG_ZERO);
+    }
+
     void* ptr = kmalloc(total);
 
     if (ptr) {
@@ -125,16 +201,18 @@ void* krealloc(void* ptr, size_t new_size) {
         return NULL;
     }
 
-    // Get old size
-    size_t old_size;
-
-    if (is_buddy_allocation(ptr)) {
-        old_size = get_buddy_size(ptr);
-    } else {
-        // For slab allocations, we need to check which cache it came from
-        // This is a limitation - we'll just allocate new and copy
-        // We don't know the exact old size, so we'll copy up to new_size
-        old_size = new_size; // Conservative estimate
+    // Usable size of the current block
+    size_t old_size = ksize(ptr);
+
+    // Large blocks grow by absorbing free buddies and shrink by giving back
+    // their tail, both without moving
+    page_t* page = virt_to_page(ptr);
+    if (page && page->owner == PAGE_OWNER_KMALLOC &&
+        new_size <= BUDDY_SIZE_FOR_ORDER(BUDDY_MAX_ORDER)) {
+        uint8_t new_order = buddy_get_order_for_size(new_size);
+        if (buddy_resize_pages(VIRT_TO_PHYS((uint64_t)ptr), new_order) == E_OK) {
+            return ptr;
+        }
     }
 
     // If new size fits in same allocation, just return the same pointer
@@ -142,15 +220,14 @@ void* krealloc(void* ptr, size_t new_size) {
         return ptr;
     }
 
-    // Allocate new block
-    void* new_ptr = kmalloc(new_size);
+    // Allocate new block, leaving room to grow in place next time
+    void* new_ptr = new_size > KMALLOC_MAX_CACHE_SIZE ? kmalloc_large(new_size, KREALLOC_HEADROOM_ORDERS, 0) : kmalloc(new_size);
     if (!new_ptr) {
         return NULL;
     }
 
-    // Copy old data
-    size_t copy_size = (old_size < new_size) ? old_size : new_size;
-    memcpy(new_ptr, ptr, copy_size);
+    // The whole old block is usable, and it is smaller than the new one
+    memcpy(new_ptr, ptr, old_size);
 
     // Free old block
     kfree(ptr);
@@ -163,9 +240,6 @@ void* krealloc(void* ptr, size_t new_size) {
 void* kmalloc_pages(size_t num_pages) {
     if (num_pages == 0) return NULL;
 
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return NULL;
-
     // Find order that fits num_pages
     uint8_t order = 0;
     size_t pages = 1;
@@ -179,7 +253,7 @@ void* kmalloc_pages(size_t num_pages) {
         return NULL; // Too many pages requested
     }
 
-    uint64_t phys = buddy_alloc_order(buddy, order);
+    uint64_t phys = buddy_alloc_pages(order, 0);
     if (!phys) return NULL;
 
     return PHYS_TO_VIRT(phys);
@@ -188,11 +262,8 @@ void* kmalloc_pages(size_t num_pages) {
 void kfree_pages(void* ptr, size_t num_pages) {
     if (!ptr) return;
 
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return;
-
     uint64_t phys = VIRT_TO_PHYS((uint64_t)ptr);
-    buddy_free(buddy, phys);
+    buddy_free_pages(phys);
 }
 
 // ============================================================================
@@ -207,23 +278,43 @@ void kmalloc_print_stats(void) {
     pmm_print_stats();
 
     // Buddy allocator stats
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (buddy) {
-        buddy_print_stats(buddy);
-    }
+    buddy_print_all_stats();
 
     // Slab allocator stats
     slab_print_all_stats();
+
+    // Internal fragmentation of small allocations, totalled since boot
+    char num_str[21];
+    console_puts("=== kmalloc Size Classes (totals since boot) ===\n");
+    console_puts("Requested:      ");
+    uitoa(small_requested_bytes / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB\n");
+
+    console_puts("Allocated:      ");
+    uitoa(small_class_bytes / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB (waste ");
+    uitoa((small_class_bytes - small_requested_bytes) / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB)\n");
+
+    console_puts("Power-of-two:   ");
+    uitoa(small_pow2_bytes / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB (saved ");
+    uitoa((small_pow2_bytes - small_class_bytes) / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB)\n");
+
+    shrinker_print_stats();
 }
 
 uint64_t kmalloc_get_used_memory(void) {
     uint64_t total = 0;
 
     // Add buddy allocator used memory
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (buddy) {
-        total += buddy_get_used_memory(buddy);
-    }
+    total += buddy_get_total_used_memory();
 
     return total;
 }
@@ -232,10 +323,7 @@ uint64_t kmalloc_get_free_memory(void) {
     uint64_t total = 0;
 
     // Add buddy allocator free memory
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (buddy) {
-        total += buddy_get_free_memory(buddy);
-    }
+    total += buddy_get_total_free_memory();
 
     return total;
 }
\ No newline at end of file
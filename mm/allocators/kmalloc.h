@@ -10,6 +10,16 @@ void kfree(void* ptr);
 void* kcalloc(size_t num, size_t size);
 void* krealloc(void* ptr, size_t new_size);
 
+// Allocate count blocks of size bytes into ptrs[] in one batch
+// Returns count, or 0 (and allocates nothing) on failure
+uint32_t kmalloc_bulk(size_t size, uint32_t count, void** ptrs);
+
+// Free count kmalloc'd blocks; runs from the same slab cache are freed together
+void kfree_bulk(uint32_t count, void** ptrs);
+
+// Usable size of a kmalloc'd block (0 if ptr did not come from kmalloc)
+size_t ksize(const void* ptr);
+
 // Page-aligned allocations
 void* kmalloc_pages(size_t num_pages);
 void kfree_pages(void* ptr, size_t num_pages);
@@ -1,6 +1,8 @@
 #include "slab.h"
 #include "buddy.h"
 #include "mm/memory_layout.h"
+#include "mm/page.h"
+#include "mm/shrinker.h"
 #include "console/console.h"
 #include "io/serial.h"
 #include "libc/string.h"
@@ -9,15 +11,22 @@
 static slab_cache_t* cache_registry[SLAB_MAX_CACHES];
 static uint32_t num_caches = 0;
 
-// Common size caches
-slab_cache_t* kmalloc_cache_32 = NULL;
-slab_cache_t* kmalloc_cache_64 = NULL;
-slab_cache_t* kmalloc_cache_128 = NULL;
-slab_cache_t* kmalloc_cache_256 = NULL;
-slab_cache_t* kmalloc_cache_512 = NULL;
-slab_cache_t* kmalloc_cache_1024 = NULL;
-slab_cache_t* kmalloc_cache_2048 = NULL;
-slab_cache_t* kmalloc_cache_4096 = NULL;
+// kmalloc size classes: powers of two plus the 1.5x steps between them
+const size_t kmalloc_class_sizes[KMALLOC_NUM_CLASSES] = {
+    8, 16, 24, 32, 48, 64, 96, 128, 192, 256,
+    384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+slab_cache_t* kmalloc_caches[KMALLOC_NUM_CLASSES];
+
+// Size class index for every 8-byte step, indexed by (size - 1) >> 3
+static uint8_t kmalloc_size_index[KMALLOC_MAX_CACHE_SIZE >> 3];
+
+// Magazines are objects of their own cache (which runs without magazines)
+static slab_cache_t* magazine_cache = NULL;
+
+// Descriptors of off-slab slabs
+static slab_cache_t* slab_desc_cache = NULL;
 
 // Minimum alignment for objects
 #define SLAB_ALIGN 8
@@ -27,13 +36,33 @@ static inline size_t align_size(size_t size, size_t align) {
     return (size + align - 1) & ~(align - 1);
 }
 
-// Calculate optimal slab order for object size
-static uint32_t calculate_slab_order(size_t object_size) {
+// Slab header size, padded so the object area keeps the cache's alignment
+static inline size_t slab_header_size(slab_cache_t* cache) {
+    if (cache->flags & SLAB_OFF_SLAB) return 0;
+    return align_size(sizeof(slab_t), cache->align);
+}
+
+// Calculate optimal slab order for a cache's object size
+static uint32_t calculate_slab_order(slab_cache_t* cache) {
+    size_t object_size = cache->aligned_size;
+    
+    // Off-slab: smallest slab that wastes at most 1/8 of itself
+    if (cache->flags & SLAB_OFF_SLAB) {
+        for (uint32_t order = 0; order <= SLAB_MAX_ORDER; order++) {
+            size_t slab_size = BUDDY_SIZE_FOR_ORDER(order);
+            if (slab_size < object_size) continue;
+            if ((slab_size % object_size) * 8 <= slab_size) {
+                return order;
+            }
+        }
+        return SLAB_MAX_ORDER;
+    }
+    
     // Try to fit at least 8 objects per slab
     size_t min_slab_size = object_size * 8;
     
     // Find smallest order that fits
-    for (uint32_t order = 0; order <= 3; order++) {
+    for (uint32_t order = 0; order <= SLAB_MAX_ORDER; order++) {
         if (BUDDY_SIZE_FOR_ORDER(order) >= min_slab_size) {
             return order;
         }
@@ -42,6 +71,13 @@ static uint32_t calculate_slab_order(size_t object_size) {
     return 2; // Default to 16KB slabs
 }
 
+// Default rounds per magazine: more for small, frequently used objects
+static uint32_t default_magazine_size(size_t object_size) {
+    if (object_size <= 256) return 32;
+    if (object_size <= 1024) return 16;
+    return 8;
+}
+
 // Remove slab from its current list
 static void remove_slab_from_list(slab_t* slab) {
     if (slab->prev) {
@@ -100,17 +136,31 @@ static void add_slab_to_list(slab_cache_t* cache, slab_t* slab) {
 
 // Allocate a new slab
 static slab_t* allocate_slab(slab_cache_t* cache) {
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return NULL;
-    
     // Allocate pages for slab
-    uint64_t phys_addr = buddy_alloc_order(buddy, cache->slab_order);
+    uint64_t phys_addr = buddy_alloc_pages(cache->slab_order, 0);
     if (!phys_addr) return NULL;
     
     void* slab_mem = PHYS_TO_VIRT(phys_addr);
     
-    // Slab header at start
+    // Slab header at start, or in a descriptor of its own for large objects
     slab_t* slab = (slab_t*)slab_mem;
+    if (cache->flags & SLAB_OFF_SLAB) {
+        slab = slab_alloc(slab_desc_cache);
+        if (!slab) {
+            buddy_free_pages(phys_addr);
+            return NULL;
+        }
+    }
+    
+    // Tag every page so frees can find the slab without searching
+    for (uint64_t i = 0; i < BUDDY_PAGES_PER_ORDER(cache->slab_order); i++) {
+        page_t* page = phys_to_page(phys_addr + i * PAGE_SIZE);
+        page->owner = PAGE_OWNER_SLAB;
+        page->slab = slab;
+        page->cache = cache;
+    }
+    
+    slab->base = slab_mem;
     slab->next = NULL;
     slab->prev = NULL;
     slab->cache = cache;
@@ -118,9 +168,12 @@ static slab_t* allocate_slab(slab_cache_t* cache) {
     slab->free_objects = cache->objects_per_slab;
     slab->state = SLAB_EMPTY;
     
-    // Objects start after slab header (aligned)
-    size_t header_size = align_size(sizeof(slab_t), SLAB_ALIGN);
-    slab->objects = (void*)((uint64_t)slab_mem + header_size);
+    // Objects start after slab header, shifted by this slab's color
+    size_t color_offset = (size_t)cache->color_next * CACHE_LINE_SIZE;
+    if (++cache->color_next >= cache->color_count) {
+        cache->color_next = 0;
+    }
+    slab->objects = (void*)((uint64_t)slab_mem + slab_header_size(cache) + color_offset);
     
     // Initialize free list
     slab->free_list = NULL;
@@ -141,9 +194,6 @@ static slab_t* allocate_slab(slab_cache_t* cache) {
 
 // Free a slab
 static void free_slab(slab_t* slab) {
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return;
-    
     slab_cache_t* cache = slab->cache;
     
     // Call destructor on all objects if provided
@@ -156,12 +206,66 @@ static void free_slab(slab_t* slab) {
     }
     
     // Free the slab memory
-    uint64_t phys_addr = VIRT_TO_PHYS((uint64_t)slab);
-    buddy_free(buddy, phys_addr);
+    uint64_t phys_addr = VIRT_TO_PHYS((uint64_t)slab->base);
+    for (uint64_t i = 0; i < BUDDY_PAGES_PER_ORDER(cache->slab_order); i++) {
+        page_t* page = phys_to_page(phys_addr + i * PAGE_SIZE);
+        page->owner = PAGE_OWNER_NONE;
+        page->slab = NULL;
+        page->cache = NULL;
+    }
+    buddy_free_pages(phys_addr);
+    
+    if (cache->flags & SLAB_OFF_SLAB) {
+        slab_free(slab_desc_cache, slab);
+    }
     
     cache->num_slabs--;
 }
 
+// Pages the slab layer could give back: empty slabs plus objects in magazines
+static uint64_t slab_shrinker_count(shrinker_t* shrinker) {
+    uint64_t pages = 0;
+    
+    for (uint32_t i = 0; i < num_caches; i++) {
+        slab_cache_t* cache = cache_registry[i];
+        
+        for (slab_t* slab = cache->slabs_empty; slab; slab = slab->next) {
+            pages += BUDDY_PAGES_PER_ORDER(cache->slab_order);
+        }
+        
+        uint64_t rounds = 0;
+        for (uint32_t c = 0; c < MAX_CPUS; c++) {
+            if (cache->cpu[c].loaded) rounds += cache->cpu[c].loaded->rounds;
+            if (cache->cpu[c].previous) rounds += cache->cpu[c].previous->rounds;
+        }
+        for (slab_magazine_t* mag = cache->depot_full; mag; mag = mag->next) {
+            rounds += mag->rounds;
+        }
+        pages += rounds * cache->aligned_size / PAGE_SIZE;
+    }
+    
+    return pages;
+}
+
+// Shrink caches newest first: draining them frees magazines and off-slab
+// descriptors into the internal caches, which were created first
+static uint64_t slab_shrinker_scan(shrinker_t* shrinker, uint64_t nr_pages) {
+    uint64_t freed = 0;
+    
+    for (uint32_t i = num_caches; i > 0 && freed < nr_pages; i--) {
+        slab_cache_t* cache = cache_registry[i - 1];
+        freed += (uint64_t)slab_cache_shrink(cache) * BUDDY_PAGES_PER_ORDER(cache->slab_order);
+    }
+    
+    return freed;
+}
+
+static shrinker_t slab_shrinker = {
+    .name = "slab",
+    .count = slab_shrinker_count,
+    .scan = slab_shrinker_scan,
+};
+
 kerr_t slab_init(void) {
     // Initialize cache registry
     for (uint32_t i = 0; i < SLAB_MAX_CACHES; i++) {
@@ -169,38 +273,59 @@ kerr_t slab_init(void) {
     }
     num_caches = 0;
     
-    // Create common size caches
-    kmalloc_cache_32 = slab_cache_create("kmalloc-32", 32, NULL, NULL);
-    kmalloc_cache_64 = slab_cache_create("kmalloc-64", 64, NULL, NULL);
-    kmalloc_cache_128 = slab_cache_create("kmalloc-128", 128, NULL, NULL);
-    kmalloc_cache_256 = slab_cache_create("kmalloc-256", 256, NULL, NULL);
-    kmalloc_cache_512 = slab_cache_create("kmalloc-512", 512, NULL, NULL);
-    kmalloc_cache_1024 = slab_cache_create("kmalloc-1024", 1024, NULL, NULL);
-    kmalloc_cache_2048 = slab_cache_create("kmalloc-2048", 2048, NULL, NULL);
-    kmalloc_cache_4096 = slab_cache_create("kmalloc-4096", 4096, NULL, NULL);
-    
-    if (!kmalloc_cache_32 || !kmalloc_cache_64 || !kmalloc_cache_128 ||
-        !kmalloc_cache_256 || !kmalloc_cache_512 || !kmalloc_cache_1024 ||
-        !kmalloc_cache_2048 || !kmalloc_cache_4096) {
+    // Off-slab descriptors come from here, so it must exist first
+    slab_desc_cache = slab_cache_create("slab-desc", sizeof(slab_t), 0, NULL, NULL);
+    if (!slab_desc_cache) {
+        return E_NOMEM;
+    }
+    slab_cache_set_magazine_size(slab_desc_cache, 0);
+    
+    magazine_cache = slab_cache_create("slab-magazine", sizeof(slab_magazine_t), 0, NULL, NULL);
+    if (!magazine_cache) {
         return E_NOMEM;
     }
+    slab_cache_set_magazine_size(magazine_cache, 0);
+    
+    // Create the kmalloc size class caches
+    for (uint32_t i = 0; i < KMALLOC_NUM_CLASSES; i++) {
+        char name[SLAB_NAME_MAX];
+        char num_str[21];
+        
+        uitoa(kmalloc_class_sizes[i], num_str);
+        strcpy(name, "kmalloc-");
+        strcat(name, num_str);
+        
+        kmalloc_caches[i] = slab_cache_create(name, kmalloc_class_sizes[i], 0, NULL, NULL);
+        if (!kmalloc_caches[i]) {
+            return E_NOMEM;
+        }
+    }
+    
+    // Build the size -> class lookup table
+    uint32_t class_idx = 0;
+    for (uint32_t i = 0; i < (KMALLOC_MAX_CACHE_SIZE >> 3); i++) {
+        size_t size = ((size_t)i + 1) << 3;
+        while (kmalloc_class_sizes[class_idx] < size) {
+            class_idx++;
+        }
+        kmalloc_size_index[i] = (uint8_t)class_idx;
+    }
     
-    serial_debug_puts("[SLAB] Initialized with 8 common caches\n");
+    shrinker_register(&slab_shrinker);
+    
+    serial_debug_puts("[SLAB] Initialized with 18 kmalloc size classes\n");
     
     return E_OK;
 }
 
-slab_cache_t* slab_cache_create(const char* name, size_t object_size,
+slab_cache_t* slab_cache_create(const char* name, size_t object_size, uint32_t flags,
                                  void (*ctor)(void*), void (*dtor)(void*)) {
     if (!name || object_size == 0 || num_caches >= SLAB_MAX_CACHES) {
         return NULL;
     }
     
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return NULL;
-    
     // Allocate cache structure from buddy
-    uint64_t cache_phys = buddy_alloc(buddy, sizeof(slab_cache_t));
+    uint64_t cache_phys = buddy_alloc_pages(buddy_get_order_for_size(sizeof(slab_cache_t)), 0);
     if (!cache_phys) return NULL;
     
     slab_cache_t* cache = (slab_cache_t*)PHYS_TO_VIRT(cache_phys);
@@ -210,15 +335,38 @@ slab_cache_t* slab_cache_create(const char* name, size_t object_size,
     cache->name[SLAB_NAME_MAX - 1] = '\0';
     
     cache->object_size = object_size;
-    cache->aligned_size = align_size(object_size, SLAB_ALIGN);
-    cache->slab_order = calculate_slab_order(cache->aligned_size);
+    cache->flags = flags;
+    
+    // Large objects keep their slab_t outside the slab so they pack exactly
+    if (object_size >= SLAB_OFF_SLAB_MIN && slab_desc_cache) {
+        cache->flags |= SLAB_OFF_SLAB;
+    }
+    
+    // Cache-line alignment, halved while two small objects still fit a line
+    cache->align = SLAB_ALIGN;
+    if (flags & SLAB_HWCACHE_ALIGN) {
+        cache->align = CACHE_LINE_SIZE;
+        while (cache->align > SLAB_ALIGN && object_size <= cache->align / 2) {
+            cache->align /= 2;
+        }
+    }
+    
+    cache->aligned_size = align_size(object_size, cache->align);
+    cache->slab_order = calculate_slab_order(cache);
     
     // Calculate objects per slab
     size_t slab_size = BUDDY_SIZE_FOR_ORDER(cache->slab_order);
-    size_t header_size = align_size(sizeof(slab_t), SLAB_ALIGN);
-    size_t usable_size = slab_size - header_size;
+    size_t usable_size = slab_size - slab_header_size(cache);
     cache->objects_per_slab = usable_size / cache->aligned_size;
     
+    // Leftover space becomes the range of cache-line color offsets
+    size_t leftover = usable_size - cache->objects_per_slab * cache->aligned_size;
+    cache->color_count = 1;
+    if (!(flags & SLAB_NO_COLOR)) {
+        cache->color_count += leftover / CACHE_LINE_SIZE;
+    }
+    cache->color_next = 0;
+    
     cache->slabs_full = NULL;
     cache->slabs_partial = NULL;
     cache->slabs_empty = NULL;
@@ -228,6 +376,18 @@ slab_cache_t* slab_cache_create(const char* name, size_t object_size,
     cache->num_slabs = 0;
     cache->num_active_objects = 0;
     
+    cache->magazine_size = default_magazine_size(object_size);
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cache->cpu[i].loaded = NULL;
+        cache->cpu[i].previous = NULL;
+    }
+    cache->depot_full = NULL;
+    cache->depot_empty = NULL;
+    cache->depot_full_count = 0;
+    cache->depot_empty_count = 0;
+    cache->magazine_hits = 0;
+    cache->magazine_misses = 0;
+    
     cache->ctor = ctor;
     cache->dtor = dtor;
     
@@ -240,6 +400,8 @@ slab_cache_t* slab_cache_create(const char* name, size_t object_size,
 void slab_cache_destroy(slab_cache_t* cache) {
     if (!cache) return;
     
+    slab_cache_drain(cache);
+    
     // Free all slabs
     while (cache->slabs_full) {
         slab_t* slab = cache->slabs_full;
@@ -273,16 +435,12 @@ void slab_cache_destroy(slab_cache_t* cache) {
     }
     
     // Free cache structure
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (buddy) {
-        uint64_t cache_phys = VIRT_TO_PHYS((uint64_t)cache);
-        buddy_free(buddy, cache_phys);
-    }
+    uint64_t cache_phys = VIRT_TO_PHYS((uint64_t)cache);
+    buddy_free_pages(cache_phys);
 }
 
-void* slab_alloc(slab_cache_t* cache) {
-    if (!cache) return NULL;
-    
+// Take an object straight from the slab lists
+static void* slab_alloc_slow(slab_cache_t* cache) {    
     slab_t* slab = NULL;
     
     // Try partial slabs first
@@ -308,86 +466,376 @@ void* slab_alloc(slab_cache_t* cache) {
     slab->free_objects--;
     
     // Update slab state
-    slab_state_t old_state = slab->state;
+    slab_state_t new_state = slab->free_objects == 0 ? SLAB_FULL : SLAB_PARTIAL;
     
-    if (slab->free_objects == 0) {
-        slab->state = SLAB_FULL;
-    } else {
-        slab->state = SLAB_PARTIAL;
+    // Move slab if state changed (unlink while state still names its list)
+    if (new_state != slab->state) {
+        remove_slab_from_list(slab);
+        slab->state = new_state;
+        add_slab_to_list(cache, slab);
+    }
+    
+    return obj;
+}
+
+// Whether obj lies in a slab of cache. Checked before an object goes into a
+// magazine, where a wrong-cache or stray pointer would be handed out again.
+static inline int slab_owns(slab_cache_t* cache, void* obj) {
+    page_t* page = virt_to_page(obj);
+    return page && page->owner == PAGE_OWNER_SLAB && page->cache == cache;
+}
+
+// Put an object straight back on its slab
+static void slab_free_slow(slab_cache_t* cache, void* obj) {    
+    // The page descriptor names the owning slab
+    if (!slab_owns(cache, obj)) {
+        serial_debug_puts("[SLAB] Warning: Object not found in any slab\n");
+        return;
     }
+    slab_t* slab = virt_to_page(obj)->slab;
+    
+    // Add to free list
+    slab_object_t* free_obj = (slab_object_t*)obj;
+    free_obj->next = slab->free_list;
+    slab->free_list = free_obj;
+    slab->free_objects++;
+    
+    // Update slab state
+    slab_state_t new_state = slab->free_objects == slab->num_objects ? SLAB_EMPTY : SLAB_PARTIAL;
     
-    // Move slab if state changed
-    if (old_state != slab->state) {
+    // Move slab if state changed (unlink while state still names its list)
+    if (new_state != slab->state) {
         remove_slab_from_list(slab);
+        slab->state = new_state;
         add_slab_to_list(cache, slab);
     }
+}
+
+// Get an empty magazine from the depot, or make a new one
+static slab_magazine_t* magazine_get_empty(slab_cache_t* cache) {
+    slab_magazine_t* mag = cache->depot_empty;
+    if (mag) {
+        cache->depot_empty = mag->next;
+        cache->depot_empty_count--;
+        return mag;
+    }
     
-    // Call constructor on first use
-    if (cache->ctor) {
-        cache->ctor(obj);
+    mag = slab_alloc_slow(magazine_cache);
+    if (mag) mag->rounds = 0;
+    return mag;
+}
+
+// Return an empty magazine to the depot
+static void magazine_put_empty(slab_cache_t* cache, slab_magazine_t* mag) {
+    mag->next = cache->depot_empty;
+    cache->depot_empty = mag;
+    cache->depot_empty_count++;
+}
+
+// Give every object in a magazine back to the slab lists and free the magazine
+static void magazine_release(slab_cache_t* cache, slab_magazine_t* mag) {
+    while (mag->rounds > 0) {
+        slab_free_slow(cache, mag->objects[--mag->rounds]);
+    }
+    slab_free_slow(magazine_cache, mag);
+}
+
+// Magazine fast path for allocation, NULL means fall back to the slabs
+static void* magazine_alloc(slab_cache_t* cache) {
+    slab_cpu_cache_t* cpu = &cache->cpu[cpu_current_id()];
+    
+    if (cpu->loaded && cpu->loaded->rounds > 0) {
+        return cpu->loaded->objects[--cpu->loaded->rounds];
+    }
+    
+    // Loaded is empty: previous might still have rounds
+    if (cpu->previous && cpu->previous->rounds > 0) {
+        slab_magazine_t* tmp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = tmp;
+        return cpu->loaded->objects[--cpu->loaded->rounds];
+    }
+    
+    // Both empty: trade one for a full magazine from the depot
+    slab_magazine_t* full = cache->depot_full;
+    if (!full) return NULL;
+    
+    cache->depot_full = full->next;
+    cache->depot_full_count--;
+    
+    if (cpu->previous) magazine_put_empty(cache, cpu->previous);
+    cpu->previous = cpu->loaded;
+    cpu->loaded = full;
+    
+    return full->objects[--full->rounds];
+}
+
+// Magazine fast path for free, returns 0 if the object must go to the slabs
+static int magazine_free(slab_cache_t* cache, void* obj) {
+    slab_cpu_cache_t* cpu = &cache->cpu[cpu_current_id()];
+    
+    if (cpu->loaded && cpu->loaded->rounds < cache->magazine_size) {
+        cpu->loaded->objects[cpu->loaded->rounds++] = obj;
+        return 1;
     }
     
-    cache->num_allocations++;
-    cache->num_active_objects++;
+    // Loaded is full: previous might have room
+    if (cpu->previous && cpu->previous->rounds < cache->magazine_size) {
+        slab_magazine_t* tmp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = tmp;
+        cpu->loaded->objects[cpu->loaded->rounds++] = obj;
+        return 1;
+    }
+    
+    slab_magazine_t* empty = magazine_get_empty(cache);
+    if (!empty) return 0;
+    
+    // Both full: park previous in the depot (or drain it if the depot is at
+    // its limit) and load the empty magazine
+    if (cpu->previous) {
+        if (cache->depot_full_count < SLAB_DEPOT_MAX) {
+            cpu->previous->next = cache->depot_full;
+            cache->depot_full = cpu->previous;
+            cache->depot_full_count++;
+        } else {
+            magazine_release(cache, cpu->previous);
+        }
+    }
+    cpu->previous = cpu->loaded;
+    cpu->loaded = empty;
+    
+    empty->objects[empty->rounds++] = obj;
+    return 1;
+}
+
+void* slab_alloc(slab_cache_t* cache) {
+    if (!cache) return NULL;
+    
+    uint64_t flags = irq_save();
+    
+    void* obj = NULL;
+    if (cache->magazine_size) {
+        obj = magazine_alloc(cache);
+    }
+    
+    if (obj) {
+        cache->magazine_hits++;
+    } else {
+        cache->magazine_misses++;
+        obj = slab_alloc_slow(cache);
+    }
+    
+    if (obj) {
+        cache->num_allocations++;
+        cache->num_active_objects++;
+    }
+    
+    irq_restore(flags);
+    
+    // Call constructor on every allocation
+    if (obj && cache->ctor) {
+        cache->ctor(obj);
+    }
     
     return obj;
 }
 
 void slab_free(slab_cache_t* cache, void* obj) {
     if (!cache || !obj) return;
+    if (!slab_owns(cache, obj)) {
+        serial_debug_puts("[SLAB] Warning: Object not found in any slab\n");
+        return;
+    }
     
-    // Find which slab owns this object
-    slab_t* slab = NULL;
+    uint64_t flags = irq_save();
+    
+    if (cache->magazine_size && magazine_free(cache, obj)) {
+        cache->magazine_hits++;
+    } else {
+        cache->magazine_misses++;
+        slab_free_slow(cache, obj);
+    }
+    
+    cache->num_frees++;
+    cache->num_active_objects--;
     
-    // Check all slab lists
-    slab_t* lists[] = {cache->slabs_full, cache->slabs_partial, cache->slabs_empty};
+    irq_restore(flags);
+}
+
+// Take up to count objects from the slab lists, moving each slab at most once
+static uint32_t slab_alloc_slow_bulk(slab_cache_t* cache, uint32_t count, void** objects) {
+    uint32_t got = 0;
     
-    for (int i = 0; i < 3; i++) {
-        slab_t* current = lists[i];
+    while (got < count) {
+        slab_t* slab = cache->slabs_partial;
+        if (!slab) slab = cache->slabs_empty;
+        if (!slab) {
+            slab = allocate_slab(cache);
+            if (!slab) break;
+            add_slab_to_list(cache, slab);
+        }
         
-        while (current) {
-            uint64_t slab_start = (uint64_t)current->objects;
-            uint64_t slab_end = slab_start + (cache->objects_per_slab * cache->aligned_size);
-            
-            if ((uint64_t)obj >= slab_start && (uint64_t)obj < slab_end) {
-                slab = current;
-                break;
-            }
-            
-            current = current->next;
+        // Pop as many objects as this slab can give in one pass
+        while (got < count && slab->free_list) {
+            slab_object_t* obj = slab->free_list;
+            slab->free_list = obj->next;
+            slab->free_objects--;
+            objects[got++] = obj;
         }
         
-        if (slab) break;
+        slab_state_t new_state = slab->free_objects == 0 ? SLAB_FULL : SLAB_PARTIAL;
+        if (new_state != slab->state) {
+            remove_slab_from_list(slab);
+            slab->state = new_state;
+            add_slab_to_list(cache, slab);
+        }
     }
     
-    if (!slab) {
-        serial_debug_puts("[SLAB] Warning: Object not found in any slab\n");
-        return;
+    return got;
+}
+
+// Return objects to their slabs, moving each slab once per run of its objects.
+// Returns how many were freed; objects not from this cache are skipped.
+static uint32_t slab_free_slow_bulk(slab_cache_t* cache, uint32_t count, void** objects) {
+    uint32_t i = 0;
+    uint32_t freed = 0;
+    
+    while (i < count) {
+        page_t* page = virt_to_page(objects[i]);
+        if (!page || page->owner != PAGE_OWNER_SLAB || page->cache != cache) {
+            serial_debug_puts("[SLAB] Warning: Object not found in any slab\n");
+            i++;
+            continue;
+        }
+        slab_t* slab = page->slab;
+        
+        // Push the run of objects that belong to this slab
+        do {
+            slab_object_t* free_obj = (slab_object_t*)objects[i];
+            free_obj->next = slab->free_list;
+            slab->free_list = free_obj;
+            slab->free_objects++;
+            freed++;
+            i++;
+            page = i < count ? virt_to_page(objects[i]) : NULL;
+        } while (page && page->owner == PAGE_OWNER_SLAB && page->slab == slab);
+        
+        slab_state_t new_state = slab->free_objects == slab->num_objects ? SLAB_EMPTY : SLAB_PARTIAL;
+        if (new_state != slab->state) {
+            remove_slab_from_list(slab);
+            slab->state = new_state;
+            add_slab_to_list(cache, slab);
+        }
     }
+
+    return freed;
+}
+
+uint32_t slab_alloc_bulk(slab_cache_t* cache, uint32_t count, void** objects) {
+    if (!cache || !objects || count == 0) return 0;
     
-    // Add to free list
-    slab_object_t* free_obj = (slab_object_t*)obj;
-    free_obj->next = slab->free_list;
-    slab->free_list = free_obj;
-    slab->free_objects++;
+    uint64_t flags = irq_save();
     
-    // Update slab state
-    slab_state_t old_state = slab->state;
+    // Empty the loaded magazine first, then go to the slabs once
+    uint32_t got = 0;
+    slab_magazine_t* mag = cache->magazine_size ? cache->cpu[cpu_current_id()].loaded : NULL;
+    while (mag && mag->rounds > 0 && got < count) {
+        objects[got++] = mag->objects[--mag->rounds];
+    }
+    cache->magazine_hits += got;
     
-    if (slab->free_objects == slab->num_objects) {
-        slab->state = SLAB_EMPTY;
-    } else {
-        slab->state = SLAB_PARTIAL;
+    if (got < count) {
+        cache->magazine_misses++;
+        got += slab_alloc_slow_bulk(cache, count - got, objects + got);
     }
     
-    // Move slab if state changed
-    if (old_state != slab->state) {
-        remove_slab_from_list(slab);
-        add_slab_to_list(cache, slab);
+    // All or nothing
+    if (got < count) {
+        slab_free_slow_bulk(cache, got, objects);
+        irq_restore(flags);
+        return 0;
     }
     
-    cache->num_frees++;
-    cache->num_active_objects--;
+    cache->num_allocations += count;
+    cache->num_active_objects += count;
+    
+    irq_restore(flags);
+    
+    if (cache->ctor) {
+        for (uint32_t i = 0; i < count; i++) {
+            cache->ctor(objects[i]);
+        }
+    }
+    
+    return count;
+}
+
+void slab_free_bulk(slab_cache_t* cache, uint32_t count, void** objects) {
+    if (!cache || !objects || count == 0) return;
+    
+    uint64_t flags = irq_save();
+    
+    // Refill the loaded magazine, the rest goes straight to the slabs (which
+    // also warn about and skip any object that is not ours)
+    uint32_t done = 0;
+    slab_magazine_t* mag = cache->magazine_size ? cache->cpu[cpu_current_id()].loaded : NULL;
+    while (mag && mag->rounds < cache->magazine_size && done < count &&
+           slab_owns(cache, objects[done])) {
+        mag->objects[mag->rounds++] = objects[done++];
+    }
+    cache->magazine_hits += done;
+    
+    // Skipped objects were never ours, so only count what went back
+    uint32_t freed = done;
+    if (done < count) {
+        cache->magazine_misses++;
+        freed += slab_free_slow_bulk(cache, count - done, objects + done);
+    }
+    
+    cache->num_frees += freed;
+    cache->num_active_objects -= freed;
+    
+    irq_restore(flags);
+}
+
+void slab_cache_drain(slab_cache_t* cache) {
+    if (!cache) return;
+    
+    uint64_t flags = irq_save();
+    
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (cache->cpu[i].loaded) magazine_release(cache, cache->cpu[i].loaded);
+        if (cache->cpu[i].previous) magazine_release(cache, cache->cpu[i].previous);
+        cache->cpu[i].loaded = NULL;
+        cache->cpu[i].previous = NULL;
+    }
+    
+    while (cache->depot_full) {
+        slab_magazine_t* mag = cache->depot_full;
+        cache->depot_full = mag->next;
+        magazine_release(cache, mag);
+    }
+    
+    while (cache->depot_empty) {
+        slab_magazine_t* mag = cache->depot_empty;
+        cache->depot_empty = mag->next;
+        magazine_release(cache, mag);
+    }
+    
+    cache->depot_full_count = 0;
+    cache->depot_empty_count = 0;
+    
+    irq_restore(flags);
+}
+
+void slab_cache_set_magazine_size(slab_cache_t* cache, uint32_t size) {
+    if (!cache) return;
+    if (size > SLAB_MAGAZINE_MAX) size = SLAB_MAGAZINE_MAX;
+    
+    // Existing magazines may hold more rounds than the new size allows
+    slab_cache_drain(cache);
+    cache->magazine_size = size;
 }
 
 uint32_t slab_cache_shrink(slab_cache_t* cache) {
@@ -395,6 +843,9 @@ uint32_t slab_cache_shrink(slab_cache_t* cache) {
     
     uint32_t freed = 0;
     
+    // Objects parked in magazines keep their slabs alive
+    slab_cache_drain(cache);
+    
     // Free all empty slabs
     while (cache->slabs_empty) {
         slab_t* slab = cache->slabs_empty;
@@ -423,7 +874,16 @@ void slab_cache_print_stats(slab_cache_t* cache) {
     console_puts("  Objects/slab:   ");
     uitoa(cache->objects_per_slab, num_str);
     console_puts(num_str);
-    console_putc('\n');
+    console_puts("  (align ");
+    uitoa(cache->align, num_str);
+    console_puts(num_str);
+    console_puts(", colors ");
+    uitoa(cache->color_count, num_str);
+    console_puts(num_str);
+    if (cache->flags & SLAB_OFF_SLAB) {
+        console_puts(", off-slab");
+    }
+    console_puts(")\n");
     
     console_puts("  Active objects: ");
     uitoa(cache->num_active_objects, num_str);
@@ -444,6 +904,27 @@ void slab_cache_print_stats(slab_cache_t* cache) {
     uitoa(cache->num_frees, num_str);
     console_puts(num_str);
     console_putc('\n');
+    
+    if (cache->magazine_size) {
+        console_puts("  Magazine size:  ");
+        uitoa(cache->magazine_size, num_str);
+        console_puts(num_str);
+        console_puts("  (depot: ");
+        uitoa(cache->depot_full_count, num_str);
+        console_puts(num_str);
+        console_puts(" full, ");
+        uitoa(cache->depot_empty_count, num_str);
+        console_puts(num_str);
+        console_puts(" empty)\n");
+        
+        console_puts("  Magazine hits:  ");
+        uitoa(cache->magazine_hits, num_str);
+        console_puts(num_str);
+        console_puts("  misses: ");
+        uitoa(cache->magazine_misses, num_str);
+        console_puts(num_str);
+        console_putc('\n');
+    }
 }
 
 void slab_print_all_stats(void) {
@@ -456,24 +937,20 @@ void slab_print_all_stats(void) {
     console_putc('\n');
 }
 
+slab_cache_t* kmalloc_cache_for(size_t size) {
+    if (size == 0 || size > KMALLOC_MAX_CACHE_SIZE) return NULL;
+    return kmalloc_caches[kmalloc_size_index[(size - 1) >> 3]];
+}
+
 void* slab_kmalloc(size_t size) {
     if (size == 0) return NULL;
     
-    // Round up to next power of 2 cache size
-    if (size <= 32) return slab_alloc(kmalloc_cache_32);
-    if (size <= 64) return slab_alloc(kmalloc_cache_64);
-    if (size <= 128) return slab_alloc(kmalloc_cache_128);
-    if (size <= 256) return slab_alloc(kmalloc_cache_256);
-    if (size <= 512) return slab_alloc(kmalloc_cache_512);
-    if (size <= 1024) return slab_alloc(kmalloc_cache_1024);
-    if (size <= 2048) return slab_alloc(kmalloc_cache_2048);
-    if (size <= 4096) return slab_alloc(kmalloc_cache_4096);
+    if (size <= KMALLOC_MAX_CACHE_SIZE) {
+        return slab_alloc(kmalloc_caches[kmalloc_size_index[(size - 1) >> 3]]);
+    }
     
     // Fall back to buddy allocator for large allocations
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) return NULL;
-    
-    uint64_t phys = buddy_alloc(buddy, size);
+    uint64_t phys = buddy_alloc_pages(buddy_get_order_for_size(size), 0);
     if (!phys) return NULL;
     
     return PHYS_TO_VIRT(phys);
@@ -482,44 +959,13 @@ void* slab_kmalloc(size_t size) {
 void slab_kfree(void* obj) {
     if (!obj) return;
     
-    // Try each cache
-    slab_cache_t* caches[] = {
-        kmalloc_cache_32, kmalloc_cache_64, kmalloc_cache_128, kmalloc_cache_256,
-        kmalloc_cache_512, kmalloc_cache_1024, kmalloc_cache_2048, kmalloc_cache_4096
-    };
-    
-    for (int i = 0; i < 8; i++) {
-        if (!caches[i]) continue;
-        
-        // Check all slab lists in this cache
-        slab_t* lists[] = {
-            caches[i]->slabs_full,
-            caches[i]->slabs_partial,
-            caches[i]->slabs_empty
-        };
-        
-        for (int j = 0; j < 3; j++) {
-            slab_t* slab = lists[j];
-            
-            while (slab) {
-                uint64_t slab_start = (uint64_t)slab->objects;
-                uint64_t slab_end = slab_start + 
-                    (caches[i]->objects_per_slab * caches[i]->aligned_size);
-                
-                if ((uint64_t)obj >= slab_start && (uint64_t)obj < slab_end) {
-                    slab_free(caches[i], obj);
-                    return;
-                }
-                
-                slab = slab->next;
-            }
-        }
+    page_t* page = virt_to_page(obj);
+    if (page && page->owner == PAGE_OWNER_SLAB) {
+        slab_free(page->cache, obj);
+        return;
     }
     
-    // Not found in slab caches - assume it's from buddy allocator
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (buddy) {
-        uint64_t phys = VIRT_TO_PHYS((uint64_t)obj);
-        buddy_free(buddy, phys);
-    }
+    // Not a slab object - it came from the large allocation fallback
+    uint64_t phys = VIRT_TO_PHYS((uint64_t)obj);
+    buddy_free_pages(phys);
 }
\ No newline at end of file
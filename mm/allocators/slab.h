@@ -4,6 +4,8 @@
 #include "libc/stdint.h"
 #include "libc/stddef.h"
 #include "error_handling/errno.h"
+#include "cpu/cpu.h"
+#include "mm/memory_layout.h"
 
 /*
  * Slab Allocator
@@ -21,11 +23,37 @@
  * - Objects are grouped into slabs (one or more pages)
  * - Slabs can be: full, partial, or empty
  * - Free objects are tracked via linked list
+ * - Slabs are colored: the object area of each new slab starts one cache
+ *   line further in (wrapping within the slab's leftover space), so the
+ *   first objects of different slabs do not all land in the same cache sets
+ * - Caches of objects of 1/8 page or more keep slab_t in a separate
+ *   descriptor (off-slab), so e.g. 4096-byte objects fill whole pages
+ * - A per-CPU magazine layer (Bonwick) sits in front of the slab lists:
+ *   each CPU has a loaded and a previous magazine of object pointers, and
+ *   a per-cache depot holds spare full and empty magazines. The common
+ *   alloc/free path only pushes or pops a magazine array.
  */
 
 #define SLAB_NAME_MAX 32
 #define SLAB_MAX_CACHES 32
 
+// Upper bound for a cache's magazine size (rounds per magazine)
+#define SLAB_MAGAZINE_MAX 64
+
+// Full magazines the depot keeps before excess frees go back to the slabs
+#define SLAB_DEPOT_MAX 8
+
+// slab_cache_create() flags
+#define SLAB_HWCACHE_ALIGN 0x01  // Align objects to cache lines
+#define SLAB_NO_COLOR      0x02  // Start every slab's objects at the same offset
+#define SLAB_OFF_SLAB      0x04  // slab_t lives in slab-desc (set automatically)
+
+// Objects this large get off-slab descriptors (1/8 of a page)
+#define SLAB_OFF_SLAB_MIN (PAGE_SIZE / 8)
+
+// Largest slab: 2^3 pages (32KB)
+#define SLAB_MAX_ORDER 3
+
 // Slab states
 typedef enum {
     SLAB_EMPTY,    // All objects free
@@ -48,6 +76,7 @@ typedef struct slab {
     struct slab* prev;          // Previous slab in list
     struct slab_cache* cache;   // Parent cache
     
+    void* base;                 // Start of the slab's pages
     void* objects;              // Start of object area
     slab_object_t* free_list;   // Free objects in this slab
     
@@ -57,6 +86,19 @@ typedef struct slab {
     slab_state_t state;
 } slab_t;
 
+// Magazine: a stack of free object pointers
+typedef struct slab_magazine {
+    struct slab_magazine* next; // Depot list link
+    uint32_t rounds;            // Objects currently held
+    void* objects[SLAB_MAGAZINE_MAX];
+} slab_magazine_t;
+
+// Per-CPU magazine pair
+typedef struct slab_cpu_cache {
+    slab_magazine_t* loaded;    // Alloc/free work on this one
+    slab_magazine_t* previous;  // Swapped in when loaded runs empty/full
+} slab_cpu_cache_t;
+
 // Slab cache (manages slabs for one object size)
 typedef struct slab_cache {
     char name[SLAB_NAME_MAX];   // Cache identifier
@@ -65,6 +107,12 @@ typedef struct slab_cache {
     size_t aligned_size;        // Size with alignment
     uint32_t objects_per_slab;  // Objects per slab
     uint32_t slab_order;        // Pages per slab (2^order)
+    uint32_t flags;             // SLAB_* creation flags
+    size_t align;               // Object alignment
+    
+    // Coloring
+    uint32_t color_count;       // Distinct offsets (1 = no coloring)
+    uint32_t color_next;        // Offset index for the next slab
     
     // Slab lists
     slab_t* slabs_full;         // Fully allocated slabs
@@ -77,6 +125,16 @@ typedef struct slab_cache {
     uint64_t num_slabs;
     uint64_t num_active_objects;
     
+    // Magazine layer
+    uint32_t magazine_size;     // Rounds per magazine, 0 disables the layer
+    slab_cpu_cache_t cpu[MAX_CPUS];
+    slab_magazine_t* depot_full;
+    slab_magazine_t* depot_empty;
+    uint32_t depot_full_count;
+    uint32_t depot_empty_count;
+    uint64_t magazine_hits;     // Served from a CPU magazine
+    uint64_t magazine_misses;   // Had to go to the slab lists
+    
     // Constructor/destructor (optional)
     void (*ctor)(void* obj);    // Called on first allocation
     void (*dtor)(void* obj);    // Called before freeing
@@ -86,7 +144,7 @@ typedef struct slab_cache {
 kerr_t slab_init(void);
 
 // Create a new slab cache
-slab_cache_t* slab_cache_create(const char* name, size_t object_size,
+slab_cache_t* slab_cache_create(const char* name, size_t object_size, uint32_t flags,
                                  void (*ctor)(void*), void (*dtor)(void*));
 
 // Destroy a slab cache (frees all slabs)
@@ -98,24 +156,37 @@ void* slab_alloc(slab_cache_t* cache);
 // Free object back to cache
 void slab_free(slab_cache_t* cache, void* obj);
 
-// Shrink cache by freeing empty slabs
+// Allocate count objects into objects[] with one pass over the slab lists
+// Returns count, or 0 (and allocates nothing) if the cache ran out of memory
+uint32_t slab_alloc_bulk(slab_cache_t* cache, uint32_t count, void** objects);
+
+// Free count objects of this cache, moving each slab once per run of its objects
+void slab_free_bulk(slab_cache_t* cache, uint32_t count, void** objects);
+
+// Shrink cache by freeing empty slabs (magazines are drained first)
 uint32_t slab_cache_shrink(slab_cache_t* cache);
 
+// Return every object held in magazines to the slab lists
+void slab_cache_drain(slab_cache_t* cache);
+
+// Set rounds per magazine (0 disables, capped at SLAB_MAGAZINE_MAX)
+void slab_cache_set_magazine_size(slab_cache_t* cache, uint32_t size);
+
 // Print cache statistics
 void slab_cache_print_stats(slab_cache_t* cache);
 
 // Print all cache statistics
 void slab_print_all_stats(void);
 
-// Common caches (created at init)
-extern slab_cache_t* kmalloc_cache_32;
-extern slab_cache_t* kmalloc_cache_64;
-extern slab_cache_t* kmalloc_cache_128;
-extern slab_cache_t* kmalloc_cache_256;
-extern slab_cache_t* kmalloc_cache_512;
-extern slab_cache_t* kmalloc_cache_1024;
-extern slab_cache_t* kmalloc_cache_2048;
-extern slab_cache_t* kmalloc_cache_4096;
+// kmalloc size classes (created at init): 8, 16, 24, 32, 48, ... 3072, 4096
+#define KMALLOC_NUM_CLASSES 18
+#define KMALLOC_MAX_CACHE_SIZE 4096
+
+extern const size_t kmalloc_class_sizes[KMALLOC_NUM_CLASSES];
+extern slab_cache_t* kmalloc_caches[KMALLOC_NUM_CLASSES];
+
+// Size class cache that serves a request of size bytes (NULL if too large)
+slab_cache_t* kmalloc_cache_for(size_t size);
 
 // Utility: Allocate from appropriate slab cache based on size
 void* slab_kmalloc(size_t size);
@@ -0,0 +1,181 @@
+#include "kstack.h"
+#include "vmm.h"
+#include "mm/allocators/buddy.h"
+#include "cpu/cpu.h"
+#include "console/console.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+#define KSTACK_WORDS (KSTACK_SLOTS / 64)
+
+// One bit per slot: holds a stack (in use or cached)
+static uint64_t slot_bitmap[KSTACK_WORDS];
+static uint64_t next_word = 0;
+
+// Cached stacks, linked through their lowest word
+static void* cache_head = NULL;
+static uint32_t cache_count = 0;
+
+// Statistics
+static uint64_t stacks_in_use = 0;
+static uint64_t stacks_mapped = 0;
+static uint64_t cache_hits = 0;
+
+// Stack address of a slot (above its guard)
+static inline uint64_t slot_stack(uint64_t slot) {
+    return VIRT_STACK_BASE + slot * KSTACK_SLOT_SIZE + (KSTACK_SLOT_SIZE - KSTACK_SIZE);
+}
+
+// Claim a free slot, KSTACK_SLOTS if the window is full. Next fit, so slots
+// freed recently are not handed out again right away.
+static uint64_t slot_claim(void) {
+    for (uint64_t n = 0; n < KSTACK_WORDS; n++) {
+        uint64_t w = (next_word + n) % KSTACK_WORDS;
+        if (slot_bitmap[w] == ~0ULL) continue;
+
+        uint64_t bit = bit_scan_forward(~slot_bitmap[w]);
+        slot_bitmap[w] |= 1ULL << bit;
+        next_word = w;
+        return w * 64 + bit;
+    }
+    return KSTACK_SLOTS;
+}
+
+static void slot_release(uint64_t stack) {
+    uint64_t slot = (stack - VIRT_STACK_BASE) / KSTACK_SLOT_SIZE;
+    slot_bitmap[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
+// Allocate and map the frames of a fresh stack in slot
+static kerr_t map_stack(uint64_t slot) {
+    uint64_t phys[KSTACK_PAGES];
+
+    for (uint32_t i = 0; i < KSTACK_PAGES; i++) {
+        phys[i] = buddy_alloc_pages(0, 0);
+        if (!phys[i]) {
+            while (i--) buddy_free_pages(phys[i]);
+            return E_NOMEM;
+        }
+    }
+
+    if (vmm_map_pages(slot_stack(slot), phys, KSTACK_PAGES, PAGE_PRESENT | PAGE_WRITE) != E_OK) {
+        vmm_unmap_range(slot_stack(slot), KSTACK_PAGES, NULL);
+        for (uint32_t i = 0; i < KSTACK_PAGES; i++) buddy_free_pages(phys[i]);
+        return E_NOMEM;
+    }
+
+    return E_OK;
+}
+
+static void unmap_stack(uint64_t stack) {
+    uint64_t phys[KSTACK_PAGES];
+
+    vmm_unmap_range(stack, KSTACK_PAGES, phys);
+    for (uint32_t i = 0; i < KSTACK_PAGES; i++) {
+        if (phys[i]) buddy_free_pages(phys[i]);
+    }
+}
+
+kerr_t kstack_init(void) {
+    memset(slot_bitmap, 0, sizeof(slot_bitmap));
+    next_word = 0;
+    cache_head = NULL;
+    cache_count = 0;
+
+    serial_debug_puts("[KSTACK] ");
+    char num_str[21];
+    uitoa(KSTACK_SLOTS, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" stack slots at 0x");
+    serial_puthex(COM1, VIRT_STACK_BASE, 16);
+    serial_debug_putc('\n');
+
+    return E_OK;
+}
+
+void* kstack_alloc(void) {
+    uint64_t flags = irq_save();
+
+    // A cached stack is still mapped
+    if (cache_head) {
+        void* stack = cache_head;
+        cache_head = *(void**)stack;
+        cache_count--;
+        cache_hits++;
+        stacks_in_use++;
+        irq_restore(flags);
+        return stack;
+    }
+
+    uint64_t slot = slot_claim();
+    irq_restore(flags);
+
+    if (slot >= KSTACK_SLOTS) {
+        serial_debug_puts("[KSTACK] Out of stack slots\n");
+        return NULL;
+    }
+
+    if (map_stack(slot) != E_OK) {
+        flags = irq_save();
+        slot_release(slot_stack(slot));
+        irq_restore(flags);
+        return NULL;
+    }
+
+    flags = irq_save();
+    stacks_in_use++;
+    stacks_mapped++;
+    irq_restore(flags);
+
+    return (void*)slot_stack(slot);
+}
+
+void kstack_free(void* stack) {
+    if (!stack) return;
+
+    uint64_t addr = (uint64_t)stack;
+    if (addr < VIRT_STACK_BASE || addr >= VIRT_STACK_BASE + VIRT_STACK_SIZE ||
+        addr != slot_stack((addr - VIRT_STACK_BASE) / KSTACK_SLOT_SIZE)) {
+        serial_debug_puts("[KSTACK] Warning: kstack_free() of pointer not from kstack_alloc: 0x");
+        serial_puthex(COM1, addr, 16);
+        serial_debug_putc('\n');
+        return;
+    }
+
+    uint64_t flags = irq_save();
+    stacks_in_use--;
+
+    if (cache_count < KSTACK_CACHE_MAX) {
+        *(void**)stack = cache_head;
+        cache_head = stack;
+        cache_count++;
+        irq_restore(flags);
+        return;
+    }
+
+    stacks_mapped--;
+    irq_restore(flags);
+
+    unmap_stack(addr);
+
+    flags = irq_save();
+    slot_release(addr);
+    irq_restore(flags);
+}
+
+void kstack_print_stats(void) {
+    char num_str[21];
+    console_puts("Kernel stacks: ");
+    uitoa(stacks_in_use, num_str);
+    console_puts(num_str);
+    console_puts(" in use, ");
+    uitoa(cache_count, num_str);
+    console_puts(num_str);
+    console_puts(" cached, ");
+    uitoa(stacks_mapped * KSTACK_SIZE / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB mapped, ");
+    uitoa(cache_hits, num_str);
+    console_puts(num_str);
+    console_puts(" reused\n");
+}
@@ -0,0 +1,35 @@
+#ifndef KSTACK_H
+#define KSTACK_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+#include "memory_layout.h"
+
+// Kernel stacks - fixed-size task stacks in the VIRT_STACK_BASE window.
+// The window is cut into slots of twice the stack size: the lower half stays
+// unmapped as a guard, the upper half is the stack, mapped page by page. An
+// overflow runs into the guard and faults instead of corrupting memory.
+// Freed stacks stay mapped on a small cache, so creating and reaping tasks
+// usually needs neither the allocator nor the page tables.
+
+#define KSTACK_SIZE         8192
+#define KSTACK_PAGES        (KSTACK_SIZE / PAGE_SIZE)
+#define KSTACK_SLOT_SIZE    (2 * KSTACK_SIZE)
+#define KSTACK_SLOTS        (VIRT_STACK_SIZE / KSTACK_SLOT_SIZE)
+
+// Mapped stacks kept for reuse
+#define KSTACK_CACHE_MAX    16
+
+// Reset the slot bitmap and the cache
+kerr_t kstack_init(void);
+
+// Get a stack, returns its lowest address (NULL if out of memory or slots)
+void* kstack_alloc(void);
+
+// Return a stack from kstack_alloc()
+void kstack_free(void* stack);
+
+// Print slot and cache usage
+void kstack_print_stats(void);
+
+#endif
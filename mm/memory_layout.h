@@ -13,14 +13,14 @@
  * 0x00100000 - 0x001FFFFF : Kernel code/data [1MB]
  * 0x00200000 - 0x002FFFFF : Initial heap [1MB]
  * 0x00300000 - 0x003FFFFF : Page frame bitmap [1MB]
- * 0x00400000 - 0x07FFFFFF : Free physical pages [124MB in 128MB system]
+ * 0x00400000 - ...        : Free physical pages (sized from the Multiboot2 memory map)
  *
  * Virtual Memory (After Higher-Half Transition):
  * ----------------------------------------------
  * 0x0000000000000000 - 0x00007FFFFFFFFFFF : User space (128TB) [FUTURE]
  * 0xFFFF800000000000 - 0xFFFF807FFFFFFFFF : Physical memory direct map (512GB)
  * 0xFFFFFFFF80000000 - 0xFFFFFFFF9FFFFFFF : Kernel code/data (512MB)
- * 0xFFFFFFFFA0000000 - 0xFFFFFFFFBFFFFFFF : Kernel heap (512MB)
+ * 0xFFFFFFFFA0000000 - 0xFFFFFFFFBFFFFFFF : Kernel heap / vmalloc (512MB)
  * 0xFFFFFFFFC0000000 - 0xFFFFFFFFDFFFFFFF : Kernel stacks (512MB)
  * 0xFFFFFFFFE0000000 - 0xFFFFFFFFFFFFFFFF : Reserved (512MB)
  */
@@ -49,7 +49,13 @@
 
 // Free physical memory starts here
 #define PHYS_FREE_START         0x00400000ULL  // 4MB
-#define PHYS_MEMORY_END         0x08000000ULL  // 128MB (default QEMU)
+
+// Assumed end of RAM when the bootloader provides no memory map
+#define PHYS_MEMORY_END_FALLBACK 0x08000000ULL  // 128MB (default QEMU)
+
+// Physical memory covered by the direct map that boot.asm builds (2MB pages),
+// vmm_init() maps the rest of RAM
+#define PHYS_DIRECT_MAP_BOOT_END 0x40000000ULL  // 1GB
 
 // ============================================================================
 // Virtual Memory Layout (Higher-Half Kernel)
@@ -68,7 +74,7 @@
 #define VIRT_KERNEL_BASE        0xFFFFFFFF80000000ULL
 #define VIRT_KERNEL_SIZE        0x0000000020000000ULL  // 512MB
 
-// Kernel heap region
+// Kernel heap region (vmalloc window, see mm/vmalloc.h)
 #define VIRT_HEAP_BASE          0xFFFFFFFFA0000000ULL
 #define VIRT_HEAP_SIZE          0x0000000020000000ULL  // 512MB
 
@@ -88,9 +94,6 @@
 #define PAGE_SHIFT              12
 #define PAGE_MASK               (~(PAGE_SIZE - 1))
 
-// Total number of 4KB pages in physical memory
-#define TOTAL_PAGES             ((PHYS_MEMORY_END - PHYS_FREE_START) / PAGE_SIZE)
-
 // Align address down to page boundary
 #define PAGE_ALIGN_DOWN(addr)   ((addr) & PAGE_MASK)
 
@@ -110,6 +113,9 @@
 // Convert virtual address to physical address (direct map region only)
 #define VIRT_TO_PHYS(virt)      ((uint64_t)(virt) - VIRT_PHYS_MAP_BASE)
 
+// Convert a kernel image address (code, data, bss) to its physical address
+#define KERNEL_VIRT_TO_PHYS(virt) ((uint64_t)(virt) - VIRT_KERNEL_BASE)
+
 // Check if virtual address is in direct map region
 #define IS_DIRECT_MAP(virt)     ((uint64_t)(virt) >= VIRT_PHYS_MAP_BASE && \
                                  (uint64_t)(virt) < (VIRT_PHYS_MAP_BASE + VIRT_PHYS_MAP_SIZE))
@@ -0,0 +1,37 @@
+#include "page.h"
+#include "pmm.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+page_t* page_array = NULL;
+uint64_t page_array_count = 0;
+
+kerr_t page_array_init(void) {
+    // PFNs start at 0, so the array also covers low memory and the kernel
+    uint64_t count = pmm_get_memory_end() / PAGE_SIZE;
+    uint64_t bytes = count * sizeof(page_t);
+    uint64_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    uint64_t phys = pmm_alloc_pages(pages);
+    if (!phys) {
+        serial_debug_puts("[PAGE] No memory for the page descriptor array\n");
+        return E_NOMEM;
+    }
+
+    page_array = (page_t*)PHYS_TO_VIRT(phys);
+    memset(page_array, 0, bytes);
+    page_array_count = count;
+
+    char num_str[32];
+    serial_debug_puts("[PAGE] ");
+    uitoa(count, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" descriptors, ");
+    uitoa(bytes / 1024, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" KB at 0x");
+    serial_puthex(COM1, phys, 16);
+    serial_debug_putc('\n');
+
+    return E_OK;
+}
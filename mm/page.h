@@ -0,0 +1,57 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include "libc/stdint.h"
+#include "libc/stddef.h"
+#include "error_handling/errno.h"
+#include "memory_layout.h"
+
+// Page descriptor array - one entry per physical page frame, indexed by PFN.
+// Lets kfree/ksize/slab_kfree find who owns an address in constant time.
+
+// Who a page frame currently belongs to
+typedef enum {
+    PAGE_OWNER_NONE = 0,    // Free, reserved, or not the head of a block
+    PAGE_OWNER_BUDDY,       // Head of an allocated buddy block (page allocations)
+    PAGE_OWNER_KMALLOC,     // Head of a large kmalloc() block
+    PAGE_OWNER_SLAB,        // Any page of a slab
+    PAGE_OWNER_VMALLOC      // Frame mapped into the vmalloc window
+} page_owner_t;
+
+struct slab;
+struct slab_cache;
+
+typedef struct page {
+    struct slab* slab;          // Owning slab (PAGE_OWNER_SLAB)
+    struct slab_cache* cache;   // Owning cache (PAGE_OWNER_SLAB)
+    uint8_t owner;              // page_owner_t
+    uint8_t order;              // Buddy order of the block this page heads
+    uint16_t flags;
+    uint32_t reserved;
+} page_t;
+
+extern page_t* page_array;
+extern uint64_t page_array_count;
+
+// Allocate the descriptor array from the PMM, covering all managed memory
+// Must run after pmm_init() and before buddy_init_zones()
+kerr_t page_array_init(void);
+
+// Descriptor for a physical address (NULL if outside the array)
+static inline page_t* phys_to_page(uint64_t phys_addr) {
+    uint64_t pfn = phys_addr >> PAGE_SHIFT;
+    return pfn < page_array_count ? &page_array[pfn] : NULL;
+}
+
+// Descriptor for a direct-map virtual address (NULL for anything else)
+static inline page_t* virt_to_page(const void* virt) {
+    if (!IS_DIRECT_MAP(virt)) return NULL;
+    return phys_to_page(VIRT_TO_PHYS(virt));
+}
+
+// Physical address a descriptor stands for
+static inline uint64_t page_to_phys(const page_t* page) {
+    return (uint64_t)(page - page_array) << PAGE_SHIFT;
+}
+
+#endif
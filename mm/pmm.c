@@ -2,27 +2,148 @@
 #include "console/console.h"
 #include "libc/string.h"
 #include "io/serial.h"
-
-//Bitmap to track page allocation status
-//Each bit represents a 4KB page
-// 0: free, 1: used
-static uint8_t* page_bitmap;
-static uint32_t total_pages;
+#include "cpu/cpu.h"
+#include "boot/multiboot2.h"
+#include "mm/allocators/buddy.h"
+#include "vmm.h"
+
+// Page frame bitmap with summary levels
+// Level 0: one bit per 4KB page                (0: free, 1: used)
+// Level 1: one bit per level 0 word             (1: all 64 pages used)
+// Level 2: one bit per level 1 word             (1: all 4096 pages used)
+// Searches skip full words through the summaries and use bsf/tzcnt inside a word.
+// Bits past the last real page are permanently set so they always look used.
+#define BITS_PER_WORD 64
+#define WORD_FULL     (~0ULL)
+
+static uint64_t* page_bitmap;     // Level 0
+static uint64_t* summary_l1;      // Level 1
+static uint64_t* summary_l2;      // Level 2
+static uint64_t l0_words;
+static uint64_t l1_words;
+static uint64_t l2_words;
+
+static uint32_t total_pages;   // Usable pages (holes and reserved ranges excluded)
 static uint32_t used_pages;
 
-//Helper, set a bit in bitmap
-static inline void bitmap_set(const uint32_t bit) {
-    page_bitmap[bit / 8] |= (1 << (bit % 8));
+// Exclusive end of the physical range covered by the bitmap
+static uint64_t memory_end;
+static uint64_t bitmap_phys;
+static size_t bitmap_bytes;
+
+// Next-fit hint: level 0 word where the last single-page allocation was found
+static uint64_t search_hint;
+
+// Set once the buddy zones own every free page, the bitmap is only early-boot state after that
+static int buddy_online = 0;
+
+static inline uint64_t words_for_bits(uint64_t bits) {
+    return (bits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+// Mask of bits [lo, hi) inside a single word (0 <= lo < hi <= 64)
+static inline uint64_t word_mask(uint64_t lo, uint64_t hi) {
+    uint64_t upper = (hi == BITS_PER_WORD) ? WORD_FULL : ((1ULL << hi) - 1);
+    return upper & ~((1ULL << lo) - 1);
+}
+
+// Propagate "word became full" up through the summaries
+static inline void summary_mark_full(uint64_t word) {
+    uint64_t l1 = word / BITS_PER_WORD;
+    summary_l1[l1] |= 1ULL << (word % BITS_PER_WORD);
+    if (summary_l1[l1] == WORD_FULL) {
+        summary_l2[l1 / BITS_PER_WORD] |= 1ULL << (l1 % BITS_PER_WORD);
+    }
+}
+
+// A word gained a free page, so it and its parents are no longer full
+static inline void summary_mark_free(uint64_t word) {
+    uint64_t l1 = word / BITS_PER_WORD;
+    summary_l1[l1] &= ~(1ULL << (word % BITS_PER_WORD));
+    summary_l2[l1 / BITS_PER_WORD] &= ~(1ULL << (l1 % BITS_PER_WORD));
 }
 
-//Helper, Clear bit in bitmap
-static inline void bitmap_clear(const uint32_t bit) {
-    page_bitmap[bit / 8] &= ~(1 << (bit % 8));
+// Set bits in one level 0 word, returns number of bits that changed
+static inline uint32_t word_set(uint64_t word, uint64_t mask) {
+    uint64_t old = page_bitmap[word];
+    page_bitmap[word] = old | mask;
+    if (page_bitmap[word] == WORD_FULL && old != WORD_FULL) {
+        summary_mark_full(word);
+    }
+    return bit_count(mask & ~old);
 }
 
-//Helper, test bit in bitmap
-static inline int bitmap_test(uint32_t bit) {
-    return page_bitmap[bit / 8] & (1 << (bit % 8));
+// Clear bits in one level 0 word, returns number of bits that changed
+static inline uint32_t word_clear(uint64_t word, uint64_t mask) {
+    uint64_t old = page_bitmap[word];
+    page_bitmap[word] = old & ~mask;
+    if (old == WORD_FULL && page_bitmap[word] != WORD_FULL) {
+        summary_mark_free(word);
+    }
+    return bit_count(mask & old);
+}
+
+// Apply set/clear to pages [first, last) a word at a time, returns changed count
+static uint32_t range_update(uint64_t first, uint64_t last, int set) {
+    uint32_t changed = 0;
+
+    while (first < last) {
+        uint64_t word = first / BITS_PER_WORD;
+        uint64_t lo = first % BITS_PER_WORD;
+        uint64_t hi = BITS_PER_WORD;
+        if ((word + 1) * BITS_PER_WORD > last) {
+            hi = last % BITS_PER_WORD;
+        }
+
+        uint64_t mask = word_mask(lo, hi);
+        changed += set ? word_set(word, mask) : word_clear(word, mask);
+
+        first = word * BITS_PER_WORD + hi;
+    }
+
+    return changed;
+}
+
+// Find the first level 0 word at or after 'word' that has a free page
+// Returns l0_words if there is none
+static uint64_t next_nonfull_word(uint64_t word) {
+    while (word < l0_words) {
+        uint64_t l1 = word / BITS_PER_WORD;
+        uint64_t candidates = ~summary_l1[l1] & (WORD_FULL << (word % BITS_PER_WORD));
+        if (candidates) {
+            word = l1 * BITS_PER_WORD + bit_scan_forward(candidates);
+            return word < l0_words ? word : l0_words;
+        }
+
+        // Rest of this level 1 word is full, find the next level 1 word with space
+        l1++;
+        while (l1 < l1_words) {
+            uint64_t l2 = l1 / BITS_PER_WORD;
+            uint64_t l1_candidates = ~summary_l2[l2] & (WORD_FULL << (l1 % BITS_PER_WORD));
+            if (l1_candidates) {
+                l1 = l2 * BITS_PER_WORD + bit_scan_forward(l1_candidates);
+                break;
+            }
+            l1 = (l2 + 1) * BITS_PER_WORD;
+        }
+
+        if (l1 >= l1_words) return l0_words;
+        word = l1 * BITS_PER_WORD;
+    }
+
+    return l0_words;
+}
+
+// Find and claim a free page in words [start, end), returns page index or -1
+static int64_t claim_free_page(uint64_t start, uint64_t end) {
+    uint64_t word = next_nonfull_word(start);
+    if (word >= end) return -1;
+
+    uint64_t bit = bit_scan_forward(~page_bitmap[word]);
+    word_set(word, 1ULL << bit);
+    search_hint = word;
+
+    return (int64_t)(word * BITS_PER_WORD + bit);
 }
 
 //Convert physical address to page index
@@ -32,33 +153,129 @@ static inline uint32_t addr_to_page(uint64_t addr) {
 
 // Convert page index to physical address
 static inline uint64_t page_to_addr(uint32_t page) {
-    return PHYS_FREE_START + (page * PAGE_SIZE);
+    return PHYS_FREE_START + ((uint64_t)page * PAGE_SIZE);
 }
 
-kerr_t pmm_init(void) {
-    // Calculate number of pages in memory
-    total_pages = (PHYS_MEMORY_END - PHYS_FREE_START) / PAGE_SIZE;
+// Clip a page-aligned physical range to the managed span
+// Returns 0 if nothing is left, otherwise stores the page index range
+static int clip_range(uint64_t start, uint64_t end, uint64_t* first, uint64_t* last) {
+    if (start < PHYS_FREE_START) start = PHYS_FREE_START;
+    if (end > memory_end) end = memory_end;
+    if (start >= end) return 0;
 
-    //Calculate bitmap size
-    size_t bitmap_size = (total_pages + 7) / 8;
+    *first = addr_to_page(start);
+    *last = addr_to_page(end);
+    return 1;
+}
 
-    serial_debug_puts("[PMM] Total Pages: ");
+// Pick a home for the bitmap: the fixed 1MB slot if it is big enough, otherwise
+// the first usable region that can hold it
+static uint64_t find_bitmap_home(const memory_region_t* map, uint32_t count) {
+    if (bitmap_bytes <= PHYS_BITMAP_SIZE) return PHYS_BITMAP_START;
+
+    uint64_t needed = PAGE_ALIGN_UP(bitmap_bytes);
+    for (uint32_t i = 0; i < count; i++) {
+        if (map[i].type != MULTIBOOT2_MEMORY_AVAILABLE) continue;
+
+        uint64_t start = PAGE_ALIGN_UP(map[i].base);
+        uint64_t end = PAGE_ALIGN_DOWN(map[i].base + map[i].length);
+        if (start < PHYS_FREE_START) start = PHYS_FREE_START;
+        if (end > memory_end) end = memory_end;
+
+        if (start < end && end - start >= needed) return start;
+    }
+
+    return 0;
+}
+
+kerr_t pmm_init(void) {
     char num_str[32];
-    uitoa(total_pages, num_str);
-    serial_debug_puts(num_str);
+    uint32_t region_count = 0;
+    const memory_region_t* map = multiboot2_get_regions(&region_count);
+
+    // The highest usable address decides how much the bitmap has to cover
+    memory_end = 0;
+    for (uint32_t i = 0; i < region_count; i++) {
+        if (map[i].type != MULTIBOOT2_MEMORY_AVAILABLE) continue;
+        uint64_t end = map[i].base + map[i].length;
+        if (end > memory_end) memory_end = end;
+    }
+
+    if (!map) {
+        serial_debug_puts("[PMM] No memory map, assuming 128MB of RAM\n");
+        memory_end = PHYS_MEMORY_END_FALLBACK;
+    }
+
+    memory_end = PAGE_ALIGN_DOWN(memory_end);
+    if (memory_end > vmm_get_direct_map_end()) {
+        serial_debug_puts("[PMM] Ignoring RAM above the direct map\n");
+        memory_end = vmm_get_direct_map_end();
+    }
+
+    if (memory_end <= PHYS_FREE_START) {
+        serial_debug_puts("[PMM] No usable memory above 4MB\n");
+        return E_NOMEM;
+    }
+
+    // Calculate size of each bitmap level
+    uint64_t span_pages = (memory_end - PHYS_FREE_START) / PAGE_SIZE;
+    l0_words = words_for_bits(span_pages);
+    l1_words = words_for_bits(l0_words);
+    l2_words = words_for_bits(l1_words);
+    bitmap_bytes = (l0_words + l1_words + l2_words) * sizeof(uint64_t);
+
+    bitmap_phys = find_bitmap_home(map, region_count);
+    if (!bitmap_phys) {
+        serial_debug_puts("[PMM] No room for the page bitmap\n");
+        return E_NOMEM;
+    }
+
+    serial_debug_puts("[PMM] Memory end: 0x");
+    serial_puthex(COM1, memory_end, 16);
     serial_debug_putc('\n');
 
     serial_debug_puts("[PMM] Bitmap Size: ");
-    uitoa(bitmap_size, num_str);
+    uitoa(bitmap_bytes, num_str);
     serial_debug_puts(num_str);
+    serial_debug_puts(" bytes at 0x");
+    serial_puthex(COM1, bitmap_phys, 16);
     serial_debug_putc('\n');
 
-    //Place bitmap at PHYS_BITMAP_START
-    page_bitmap = (uint8_t*)PHYS_BITMAP_START;
+    page_bitmap = (uint64_t*)PHYS_TO_VIRT(bitmap_phys);
+    summary_l1 = page_bitmap + l0_words;
+    summary_l2 = summary_l1 + l1_words;
 
-    //Mark all pages as free
-    memset(page_bitmap, 0, bitmap_size);
+    //Start with everything used (this also covers the padding bits past the end),
+    //then release what the memory map says is usable
+    memset(page_bitmap, 0xFF, bitmap_bytes);
+    total_pages = 0;
     used_pages = 0;
+    search_hint = 0;
+
+    uint64_t first, last;
+    if (map) {
+        for (uint32_t i = 0; i < region_count; i++) {
+            if (map[i].type != MULTIBOOT2_MEMORY_AVAILABLE) continue;
+            // Partial pages at either end are not usable
+            uint64_t start = PAGE_ALIGN_UP(map[i].base);
+            uint64_t end = PAGE_ALIGN_DOWN(map[i].base + map[i].length);
+            if (clip_range(start, end, &first, &last)) {
+                total_pages += range_update(first, last, 0);
+            }
+        }
+
+        //Reserved ranges win over overlapping available ones
+        for (uint32_t i = 0; i < region_count; i++) {
+            if (map[i].type == MULTIBOOT2_MEMORY_AVAILABLE) continue;
+            uint64_t start = PAGE_ALIGN_DOWN(map[i].base);
+            uint64_t end = PAGE_ALIGN_UP(map[i].base + map[i].length);
+            if (clip_range(start, end, &first, &last)) {
+                total_pages -= range_update(first, last, 1);
+            }
+        }
+    } else {
+        total_pages = range_update(0, span_pages, 0);
+    }
 
     //Mark used regions
     //1: low memory 0-1MB
@@ -70,8 +287,21 @@ kerr_t pmm_init(void) {
     //3: Initial heap 2-3MB
     pmm_mark_region_used(PHYS_HEAP_START, PHYS_HEAP_END);
 
-    // 4. Bitmap itself (3MB-4MB)
+    // 4. Bitmap itself (3MB-4MB, or wherever it had to go)
     pmm_mark_region_used(PHYS_BITMAP_START, PHYS_BITMAP_END);
+    pmm_mark_region_used(bitmap_phys, bitmap_phys + bitmap_bytes);
+
+    serial_debug_puts("[PMM] Total Pages: ");
+    uitoa(total_pages, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_putc('\n');
+
+    if (multiboot2_get_acpi_reclaimable()) {
+        serial_debug_puts("[PMM] ACPI reclaimable (kept reserved): ");
+        uitoa(multiboot2_get_acpi_reclaimable() / 1024, num_str);
+        serial_debug_puts(num_str);
+        serial_debug_puts(" KB\n");
+    }
 
     serial_debug_puts("[PMM] Initialization complete\n");
     serial_debug_puts("[PMM] Free memory: ");
@@ -83,63 +313,103 @@ kerr_t pmm_init(void) {
 }
 
 uint64_t pmm_alloc_page(void) {
-    //Find first free page
-    for (size_t i = 0; i < total_pages; i++) {
-        if (!bitmap_test(i)) {
-            bitmap_set(i);
-            used_pages++;
-            return page_to_addr(i);
-        }
-    }
+    if (buddy_online) return buddy_alloc_pages(0, 0);
+    return pmm_bitmap_alloc_page();
+}
+
+uint64_t pmm_bitmap_alloc_page(void) {
+    //Next-fit: search from the hint, then wrap around
+    int64_t page = claim_free_page(search_hint, l0_words);
+    if (page < 0) page = claim_free_page(0, search_hint);
 
     //Out of memory(would return E_NOMEM but return type must be uint64_t)
-    return 0;
+    if (page < 0) return 0;
+
+    used_pages++;
+    return page_to_addr((uint32_t)page);
+}
+
+uint64_t pmm_alloc_zeroed_page(void) {
+    if (buddy_online) return buddy_alloc_pages(0, BUDDY_FLAG_ZERO);
+
+    uint64_t phys_addr = pmm_alloc_page();
+    if (phys_addr) memset(PHYS_TO_VIRT(phys_addr), 0, PAGE_SIZE);
+    return phys_addr;
 }
 
 void pmm_free_page(uint64_t phys_addr) {
-    if (phys_addr < PHYS_LOW_MEM_START || phys_addr >= PHYS_HEAP_END) {
-        serial_debug_puts("[PMM] E_INVALID free_page() call! Memory out of range");
+    if (phys_addr < PHYS_FREE_START) {
+        serial_debug_puts("[PMM] E_INVALID free_page() call! Memory out of range\n");
         return;
     }
 
     if (!IS_PAGE_ALIGNED(phys_addr)) {
-        serial_debug_puts("[PMM] E_INVALID free_page() call! Must be page aligned");
+        serial_debug_puts("[PMM] E_INVALID free_page() call! Must be page aligned\n");
+        return;
+    }
+
+    if (buddy_online) {
+        buddy_free_pages(phys_addr);
         return;
     }
 
+    pmm_bitmap_free_page(phys_addr);
+}
+
+void pmm_bitmap_free_page(uint64_t phys_addr) {
+    if (phys_addr < PHYS_FREE_START || phys_addr >= memory_end) return;
     uint32_t page = addr_to_page(phys_addr);
-    if (page >= total_pages) return;
 
-    if (bitmap_test(page)) {
-        bitmap_clear(page);
-        used_pages--;
-    }
+    used_pages -= word_clear(page / BITS_PER_WORD, 1ULL << (page % BITS_PER_WORD));
 }
 
 uint64_t pmm_alloc_pages(size_t count) {
     if (count == 0) return 0;
     if (count == 1) return pmm_alloc_page();
 
-    //Find contiguous free pages
-    uint32_t contiguous = 0;
-    uint32_t start = 0;
+    if (buddy_online) {
+        //Rounded up to a power of two, pmm_free_pages() releases the whole block
+        if (count > BUDDY_PAGES_PER_ORDER(BUDDY_MAX_ORDER)) return 0;
+        return buddy_alloc_pages(buddy_get_order_for_size(count * PAGE_SIZE), 0);
+    }
 
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if (!bitmap_test(i)) {
-            if (contiguous == 0) start = i;
-            contiguous++;
+    return pmm_bitmap_alloc_pages(count);
+}
 
-            if (contiguous == count) {
-                //Found enough pages
-                for (uint32_t j = start; j < start + count; j++) {
-                    bitmap_set(j);
-                }
+uint64_t pmm_bitmap_alloc_pages(size_t count) {
+    if (count == 0) return 0;
 
-                used_pages+=count;
-                return page_to_addr(start);
+    //Find contiguous free pages, consuming a word's worth of bits per step
+    uint64_t page = 0;
+    uint64_t run_start = 0;
+    uint64_t run_len = 0;
+
+    while (page < l0_words * BITS_PER_WORD) {
+        uint64_t word = page / BITS_PER_WORD;
+        uint64_t bit = page % BITS_PER_WORD;
+        uint64_t used = page_bitmap[word] >> bit;
+
+        if (used & 1) {
+            //Skip the used pages in this word, then any completely full words
+            run_len = 0;
+            page += bit_scan_forward(~used);
+            if (page % BITS_PER_WORD == 0) {
+                page = next_nonfull_word(page / BITS_PER_WORD) * BITS_PER_WORD;
             }
-        }else {
-            contiguous = 0;
+            continue;
+        }
+
+        if (run_len == 0) run_start = page;
+
+        //Free pages until the next used bit or the end of the word
+        uint64_t span = used ? bit_scan_forward(used) : BITS_PER_WORD - bit;
+        run_len += span;
+        page += span;
+
+        if (run_len >= count) {
+            //Found enough pages
+            used_pages += range_update(run_start, run_start + count, 1);
+            return page_to_addr((uint32_t)run_start);
         }
     }
 
@@ -147,58 +417,100 @@ uint64_t pmm_alloc_pages(size_t count) {
 }
 
 void pmm_free_pages(uint64_t phys_addr, size_t count) {
-    for (size_t i = 0; i < count; i++) {
-        pmm_free_page(phys_addr + (i * PAGE_SIZE));
+    if (count == 0 || !IS_PAGE_ALIGNED(phys_addr)) return;
+
+    if (buddy_online) {
+        buddy_free_pages(phys_addr);
+        return;
     }
+
+    pmm_bitmap_free_pages(phys_addr, count);
+}
+
+void pmm_bitmap_free_pages(uint64_t phys_addr, size_t count) {
+    uint64_t first, last;
+    if (!clip_range(phys_addr, phys_addr + count * PAGE_SIZE, &first, &last)) return;
+
+    used_pages -= range_update(first, last, 0);
 }
 
 void pmm_mark_region_used(uint64_t start, uint64_t end) {
+    if (buddy_online) {
+        serial_debug_puts("[PMM] E_INVALID mark_region_used() after buddy handoff\n");
+        return;
+    }
+
     //Align to boundaries
     start = PAGE_ALIGN_DOWN(start);
-
     end = PAGE_ALIGN_UP(end);
 
     //Only mark pages in region
-    if (start < PHYS_FREE_START) {
-        start = PHYS_FREE_START;
-        end += PHYS_FREE_START;
-    }
-    if (end > PHYS_MEMORY_END) end = PHYS_MEMORY_END;
-    if (start >= end) {
-        serial_debug_puts("[PMM] E_INVALID start cannot be greater than or equal to end\n");
-        return;
-    }
-
-    uint32_t start_page = addr_to_page(start);
-    uint32_t end_page = addr_to_page(end);
+    uint64_t first, last;
+    if (!clip_range(start, end, &first, &last)) return;  // Entirely outside the managed range
 
-    for (uint32_t i = start_page; i < end_page && i < total_pages; i++) {
-        if (!bitmap_test(i)) {
-            bitmap_set(i);
-            used_pages++;
-        }
-    }
+    used_pages += range_update(first, last, 1);
 }
 
 void pmm_mark_region_free(uint64_t start, uint64_t end) {
+    if (buddy_online) {
+        serial_debug_puts("[PMM] E_INVALID mark_region_free() after buddy handoff\n");
+        return;
+    }
+
     start = PAGE_ALIGN_DOWN(start);
     end = PAGE_ALIGN_UP(end);
-    if (start < PHYS_FREE_START) start = PHYS_FREE_START;
-    if (end > PHYS_MEMORY_END) end = PHYS_MEMORY_END;
-    if (start >= end) {
-        serial_debug_puts("[PMM] E_INVALID start cannot be greater than end");
+    uint64_t first, last;
+    if (!clip_range(start, end, &first, &last)) {
+        serial_debug_puts("[PMM] E_INVALID start cannot be greater than end\n");
         return;
     }
 
-    uint32_t start_page = addr_to_page(start);
-    uint32_t end_page = addr_to_page(end);
+    used_pages -= range_update(first, last, 0);
+}
+
+uint64_t pmm_find_free_range(uint64_t from, uint64_t* range_end) {
+    if (from < PHYS_FREE_START) from = PHYS_FREE_START;
+    if (from >= memory_end) return 0;
+
+    uint64_t limit = l0_words * BITS_PER_WORD;
+    uint64_t page = addr_to_page(from);
+
+    //Skip used pages, then any completely full words
+    while (page < limit) {
+        uint64_t used = page_bitmap[page / BITS_PER_WORD] >> (page % BITS_PER_WORD);
+        if (!(used & 1)) break;
+
+        page += bit_scan_forward(~used);
+        if (page % BITS_PER_WORD == 0) {
+            page = next_nonfull_word(page / BITS_PER_WORD) * BITS_PER_WORD;
+        }
+    }
+
+    if (page >= limit) return 0;
+    uint64_t first = page;
 
-    for (uint32_t i = start_page; i < end_page && i < total_pages; i++) {
-        if (bitmap_test(i)) {
-            bitmap_clear(i);
-            used_pages--;
+    //Extend the run up to the next used page (padding bits stop it at the end)
+    while (page < limit) {
+        uint64_t bit = page % BITS_PER_WORD;
+        uint64_t used = page_bitmap[page / BITS_PER_WORD] >> bit;
+        if (used) {
+            page += bit_scan_forward(used);
+            break;
         }
+        page += BITS_PER_WORD - bit;
     }
+
+    *range_end = page_to_addr((uint32_t)page);
+    return page_to_addr((uint32_t)first);
+}
+
+void pmm_handoff(void) {
+    buddy_online = 1;
+    serial_debug_puts("[PMM] Free pages handed to the buddy zones\n");
+}
+
+uint64_t pmm_get_memory_end(void) {
+    return memory_end;
 }
 
 uint32_t pmm_get_total_pages(void) {
@@ -206,11 +518,17 @@ uint32_t pmm_get_total_pages(void) {
 }
 
 uint32_t pmm_get_used_pages(void) {
+    //Pages in use before the handoff never reach the buddy free lists
+    if (buddy_online) return total_pages - (uint32_t)(buddy_get_total_free_memory() / PAGE_SIZE);
+    return used_pages;
+}
+
+uint32_t pmm_bitmap_used_pages(void) {
     return used_pages;
 }
 
 uint32_t pmm_get_free_pages(void) {
-    return total_pages - used_pages;
+    return total_pages - pmm_get_used_pages();
 }
 
 uint64_t pmm_get_total_memory(void) {
@@ -218,7 +536,7 @@ uint64_t pmm_get_total_memory(void) {
 }
 
 uint64_t pmm_get_used_memory(void) {
-    return (uint64_t)used_pages * PAGE_SIZE;
+    return (uint64_t)pmm_get_used_pages() * PAGE_SIZE;
 }
 
 uint64_t pmm_get_free_memory(void) {
@@ -242,7 +560,7 @@ void pmm_print_stats(void) {
     uitoa(pmm_get_used_memory() / 1024 / 1024, num_str);
     console_puts(num_str);
     console_puts(" MB (");
-    uitoa(used_pages, num_str);
+    uitoa(pmm_get_used_pages(), num_str);
     console_puts(num_str);
     console_puts(" pages)\n");
 
@@ -257,5 +575,37 @@ void pmm_print_stats(void) {
     console_puts("Page size:    ");
     uitoa(PAGE_SIZE, num_str);
     console_puts(num_str);
-    console_puts(" bytes\n\n");
-}
\ No newline at end of file
+    console_puts(" bytes\n");
+
+    console_puts("Bitmap words: ");
+    uitoa(l0_words, num_str);
+    console_puts(num_str);
+    console_puts(" / ");
+    uitoa(l1_words, num_str);
+    console_puts(num_str);
+    console_puts(" / ");
+    uitoa(l2_words, num_str);
+    console_puts(num_str);
+    console_puts(" (L0/L1/L2)\n");
+
+    console_puts("Allocator:    ");
+    console_puts(buddy_online ? "buddy zones (bitmap retired)\n" : "boot bitmap\n");
+
+    uint32_t region_count = 0;
+    const memory_region_t* map = multiboot2_get_regions(&region_count);
+    if (map) {
+        console_puts("\nMemory map:\n");
+        for (uint32_t i = 0; i < region_count; i++) {
+            console_puts("  ");
+            uitoa(map[i].base / 1024, num_str);
+            console_puts(num_str);
+            console_puts(" KB - ");
+            uitoa((map[i].base + map[i].length) / 1024, num_str);
+            console_puts(num_str);
+            console_puts(" KB  ");
+            console_puts(multiboot2_region_type_name(map[i].type));
+            console_putc('\n');
+        }
+    }
+    console_putc('\n');
+}
@@ -16,6 +16,9 @@ kerr_t pmm_init(void);
 // Returns physical address of the page, or 0 on failure
 uint64_t pmm_alloc_page(void);
 
+// Allocate a zeroed page (pre-zeroed pool once the buddy allocator is up)
+uint64_t pmm_alloc_zeroed_page(void);
+
 // Free a single 4KB physical page frame
 // addr must be page-aligned physical address
 void pmm_free_page(uint64_t phys_addr);
@@ -27,7 +30,30 @@ uint64_t pmm_alloc_pages(size_t count);
 // Free multiple contiguous pages
 void pmm_free_pages(uint64_t phys_addr, size_t count);
 
+// Early boot only: the bitmap is the allocator until the buddy zones take over.
+// After pmm_handoff() the alloc/free calls above forward to the buddy zones.
+
+// The bitmap allocator itself, which the calls above use until the handoff.
+// Afterwards the bitmap is retired and only pmmbench exercises it: frames it
+// hands out then belong to the buddy zones and must not be touched.
+uint64_t pmm_bitmap_alloc_page(void);
+void pmm_bitmap_free_page(uint64_t phys_addr);
+uint64_t pmm_bitmap_alloc_pages(size_t count);
+void pmm_bitmap_free_pages(uint64_t phys_addr, size_t count);
+uint32_t pmm_bitmap_used_pages(void);
+
+// Find the next run of free pages at or above 'from'
+// Returns its start address (0 if none) and stores the exclusive end
+uint64_t pmm_find_free_range(uint64_t from, uint64_t* range_end);
+
+// Called by buddy_init_zones() once it owns every free page
+void pmm_handoff(void);
+
+// Exclusive end of the managed physical range
+uint64_t pmm_get_memory_end(void);
+
 // Mark a physical memory region as used (for kernel, hardware, etc.)
+// Only valid before the handoff
 void pmm_mark_region_used(uint64_t start, uint64_t end);
 
 // Mark a physical memory region as free
@@ -0,0 +1,82 @@
+#include "shrinker.h"
+#include "console/console.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+static shrinker_t* shrinkers = NULL;
+
+// Set while shrinkers run, so an allocation made by a shrinker cannot recurse
+static int in_reclaim = 0;
+
+kerr_t shrinker_register(shrinker_t* shrinker) {
+    if (!shrinker || !shrinker->count || !shrinker->scan) return E_INVALID;
+
+    for (shrinker_t* s = shrinkers; s; s = s->next) {
+        if (s == shrinker) return E_EXISTS;
+    }
+
+    shrinker->scans = 0;
+    shrinker->reclaimed = 0;
+    shrinker->next = shrinkers;
+    shrinkers = shrinker;
+
+    return E_OK;
+}
+
+void shrinker_unregister(shrinker_t* shrinker) {
+    shrinker_t** link = &shrinkers;
+    while (*link) {
+        if (*link == shrinker) {
+            *link = shrinker->next;
+            shrinker->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+uint64_t shrink_all(uint64_t nr_pages) {
+    if (in_reclaim || nr_pages == 0) return 0;
+    in_reclaim = 1;
+
+    uint64_t freed = 0;
+    for (shrinker_t* s = shrinkers; s && freed < nr_pages; s = s->next) {
+        if (s->count(s) == 0) continue;
+
+        uint64_t got = s->scan(s, nr_pages - freed);
+        s->scans++;
+        s->reclaimed += got;
+        freed += got;
+    }
+
+    in_reclaim = 0;
+
+    if (freed) {
+        char num_str[32];
+        serial_debug_puts("[SHRINKER] Reclaimed ");
+        uitoa(freed, num_str);
+        serial_debug_puts(num_str);
+        serial_debug_puts(" pages\n");
+    }
+
+    return freed;
+}
+
+void shrinker_print_stats(void) {
+    char num_str[32];
+
+    console_puts("=== Shrinkers ===\n");
+    for (shrinker_t* s = shrinkers; s; s = s->next) {
+        console_puts(s->name);
+        console_puts(": ");
+        uitoa(s->count(s), num_str);
+        console_puts(num_str);
+        console_puts(" reclaimable pages, ");
+        uitoa(s->scans, num_str);
+        console_puts(num_str);
+        console_puts(" scans, ");
+        uitoa(s->reclaimed, num_str);
+        console_puts(num_str);
+        console_puts(" pages reclaimed\n");
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SHRINKER_H
+#define SHRINKER_H
+
+#include "libc/stdint.h"
+#include "libc/stddef.h"
+#include "error_handling/errno.h"
+
+// Shrinkers - callbacks that give memory back when the buddy allocator runs dry.
+// Caches that hold on to free memory (slab, later block and dentry caches)
+// register one; buddy_alloc_pages() runs them all before it reports failure.
+
+typedef struct shrinker {
+    const char* name;
+
+    // Pages this cache could free right now (an estimate is fine)
+    uint64_t (*count)(struct shrinker* shrinker);
+
+    // Free up to nr_pages pages, returns pages actually freed
+    uint64_t (*scan)(struct shrinker* shrinker, uint64_t nr_pages);
+
+    // Statistics
+    uint64_t scans;
+    uint64_t reclaimed;
+
+    struct shrinker* next;
+} shrinker_t;
+
+// Add a shrinker to the registry (the struct must stay alive while registered)
+kerr_t shrinker_register(shrinker_t* shrinker);
+
+// Remove a shrinker from the registry
+void shrinker_unregister(shrinker_t* shrinker);
+
+// Ask every shrinker for memory until nr_pages are freed
+// Returns pages freed (0 if nothing could be reclaimed or reclaim is already running)
+uint64_t shrink_all(uint64_t nr_pages);
+
+// Print registered shrinkers and what they reclaimed
+void shrinker_print_stats(void);
+
+#endif
@@ -0,0 +1,435 @@
+#include "vmalloc.h"
+#include "vmm.h"
+#include "page.h"
+#include "mm/allocators/buddy.h"
+#include "cpu/cpu.h"
+#include "console/console.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+#define VMALLOC_WORDS (VMALLOC_PAGES / 64)
+
+// Frames allocated and mapped (or unmapped and freed) per vmm range call
+#define VMALLOC_BATCH 64
+
+// One bit per window page: reserved (area or guard), last page of an area,
+// and page of a vmalloc_lazy() area (filled in by vmalloc_fault())
+static uint64_t used_bitmap[VMALLOC_WORDS];
+static uint64_t end_bitmap[VMALLOC_WORDS];
+static uint64_t lazy_bitmap[VMALLOC_WORDS];
+
+// Statistics
+static uint64_t vmalloc_areas = 0;
+static uint64_t vmalloc_reserved_pages = 0;
+static uint64_t vmalloc_mapped_pages = 0;
+static uint64_t vmalloc_calls = 0;
+static uint64_t vfree_calls = 0;
+static uint64_t vmalloc_failures = 0;
+
+static inline int window_test(const uint64_t* bitmap, uint64_t index) {
+    return (bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+static inline void window_set(uint64_t* bitmap, uint64_t index) {
+    bitmap[index / 64] |= 1ULL << (index % 64);
+}
+
+static inline void window_clear(uint64_t* bitmap, uint64_t index) {
+    bitmap[index / 64] &= ~(1ULL << (index % 64));
+}
+
+// First fit: lowest run of count free window pages starting at an index with
+// index % align == phase, VMALLOC_PAGES if none. Whole free or fully
+// reserved words are stepped over 64 pages at a time.
+static uint64_t find_free_range(uint64_t count, uint64_t align, uint64_t phase) {
+    uint64_t run_start = 0;
+    uint64_t run_len = 0;
+    uint64_t index = 0;
+
+    while (index < VMALLOC_PAGES) {
+        if (index % 64 == 0) {
+            uint64_t word = used_bitmap[index / 64];
+            if (word == ~0ULL) {
+                run_len = 0;
+                index += 64;
+                continue;
+            }
+            if (word == 0 && (run_len > 0 || index % align == phase)) {
+                if (run_len == 0) run_start = index;
+                run_len += 64;
+                if (run_len >= count) return run_start;
+                index += 64;
+                continue;
+            }
+        }
+
+        if (window_test(used_bitmap, index)) {
+            run_len = 0;
+        } else if (run_len > 0 || index % align == phase) {
+            if (run_len == 0) run_start = index;
+            if (++run_len >= count) return run_start;
+        }
+        index++;
+    }
+
+    return VMALLOC_PAGES;
+}
+
+// Reserve count window pages (area plus guard) with the bitmap locked
+// Lazy areas have every page but the guard marked for demand paging
+static uint64_t reserve_range(uint64_t count, uint64_t align, uint64_t phase, int lazy) {
+    uint64_t flags = irq_save();
+
+    uint64_t start = find_free_range(count, align, phase);
+    if (start < VMALLOC_PAGES) {
+        for (uint64_t i = start; i < start + count; i++) {
+            window_set(used_bitmap, i);
+            if (lazy && i < start + count - VMALLOC_GUARD_PAGES) window_set(lazy_bitmap, i);
+        }
+        window_set(end_bitmap, start + count - 1);
+
+        vmalloc_areas++;
+        vmalloc_reserved_pages += count;
+    }
+
+    irq_restore(flags);
+    return start;
+}
+
+static void release_range(uint64_t start, uint64_t count) {
+    uint64_t flags = irq_save();
+
+    for (uint64_t i = start; i < start + count; i++) {
+        window_clear(used_bitmap, i);
+        window_clear(lazy_bitmap, i);
+    }
+    window_clear(end_bitmap, start + count - 1);
+
+    vmalloc_areas--;
+    vmalloc_reserved_pages -= count;
+
+    irq_restore(flags);
+}
+
+// Unmap count pages from virt. With free_frames set the frames vmalloc()
+// allocated go back to the buddy allocator; those areas only use 4KB pages,
+// so batching never splits anything. Frames mapped by vmap() and vmap_range()
+// belong to the caller, and their area goes in one call so whole huge pages
+// are simply cleared. Pages of a lazy area that were never touched are
+// skipped. E_NOMEM if part of the range is still mapped.
+static kerr_t unmap_pages(uint64_t virt, uint64_t count, int free_frames) {
+    if (!free_frames) return vmm_unmap_range_all(virt, count, NULL);
+
+    uint64_t phys[VMALLOC_BATCH];
+    kerr_t err = E_OK;
+
+    for (uint64_t done = 0; done < count && err == E_OK; done += VMALLOC_BATCH) {
+        uint64_t batch = count - done < VMALLOC_BATCH ? count - done : VMALLOC_BATCH;
+        err = vmm_unmap_range_all(virt + done * PAGE_SIZE, batch, phys);
+
+        for (uint64_t i = 0; i < batch; i++) {
+            page_t* page = phys[i] ? phys_to_page(phys[i]) : NULL;
+            if (!page || page->owner != PAGE_OWNER_VMALLOC) continue;
+
+            buddy_free_pages(phys[i]);
+            vmalloc_mapped_pages--;
+        }
+    }
+
+    return err;
+}
+
+// Whether the area at index holds frames vmalloc() allocated: lazy areas
+// always do, others if their first page is one
+static int area_owns_frames(uint64_t index) {
+    if (window_test(lazy_bitmap, index)) return 1;
+
+    uint64_t phys = vmm_get_physical(VMALLOC_START + index * PAGE_SIZE);
+    page_t* page = phys ? phys_to_page(phys) : NULL;
+    return page && page->owner == PAGE_OWNER_VMALLOC;
+}
+
+// Window index of an area start, VMALLOC_PAGES if addr is not one
+static uint64_t area_index(const void* addr) {
+    if (!is_vmalloc_addr(addr) || !IS_PAGE_ALIGNED((uint64_t)addr)) return VMALLOC_PAGES;
+
+    uint64_t index = ((uint64_t)addr - VMALLOC_START) / PAGE_SIZE;
+    if (!window_test(used_bitmap, index)) return VMALLOC_PAGES;
+
+    // The page before an area start is free or ends another area
+    if (index > 0 && window_test(used_bitmap, index - 1) && !window_test(end_bitmap, index - 1)) {
+        return VMALLOC_PAGES;
+    }
+
+    return index;
+}
+
+// Window pages of the area at index, guard included
+static uint64_t area_span(uint64_t index) {
+    uint64_t last = index;
+    while (!window_test(end_bitmap, last)) {
+        last++;
+    }
+    return last - index + 1;
+}
+
+static void* vmalloc_area(size_t size, int zero) {
+    if (size == 0) return NULL;
+    vmalloc_calls++;
+
+    uint64_t pages = PAGE_ALIGN_UP((uint64_t)size) / PAGE_SIZE;
+    uint64_t span = pages + VMALLOC_GUARD_PAGES;
+
+    uint64_t start = span <= VMALLOC_PAGES ? reserve_range(span, 1, 0, 0) : VMALLOC_PAGES;
+    if (start >= VMALLOC_PAGES) {
+        serial_debug_puts("[VMALLOC] No free range for ");
+        char num_str[21];
+        uitoa(pages, num_str);
+        serial_debug_puts(num_str);
+        serial_debug_puts(" pages\n");
+        vmalloc_failures++;
+        return NULL;
+    }
+
+    uint64_t virt = VMALLOC_START + start * PAGE_SIZE;
+
+    // Frames come one page at a time, so fragmentation does not matter
+    uint64_t phys[VMALLOC_BATCH];
+    for (uint64_t done = 0; done < pages; done += VMALLOC_BATCH) {
+        uint64_t batch = pages - done < VMALLOC_BATCH ? pages - done : VMALLOC_BATCH;
+
+        for (uint64_t i = 0; i < batch; i++) {
+            phys[i] = buddy_alloc_pages(0, zero ? BUDDY_FLAG_ZERO : 0);
+            if (!phys[i]) {
+                while (i--) buddy_free_pages(phys[i]);
+                goto fail;
+            }
+        }
+
+        if (vmm_map_pages(virt + done * PAGE_SIZE, phys, batch, PAGE_PRESENT | PAGE_WRITE) != E_OK) {
+            // Part of the batch may be mapped, take it down before freeing
+            vmm_unmap_range(virt + done * PAGE_SIZE, batch, NULL);
+            for (uint64_t i = 0; i < batch; i++) {
+                buddy_free_pages(phys[i]);
+            }
+            goto fail;
+        }
+
+        for (uint64_t i = 0; i < batch; i++) {
+            phys_to_page(phys[i])->owner = PAGE_OWNER_VMALLOC;
+        }
+        vmalloc_mapped_pages += batch;
+    }
+
+    return (void*)virt;
+
+fail:
+    // 4KB pages only, so this cannot run out of memory
+    unmap_pages(virt, pages, 1);
+    release_range(start, span);
+    vmalloc_failures++;
+    return NULL;
+}
+
+// Back a page of a lazy area with a zeroed frame on first touch
+// Guard pages and pages of other areas are left to fault
+static kerr_t vmalloc_fault(vm_region_t* region, uint64_t addr, uint64_t error_code) {
+    (void)region;
+    (void)error_code;
+
+    if (!window_test(lazy_bitmap, (addr - VMALLOC_START) / PAGE_SIZE)) return E_NOTFOUND;
+
+    uint64_t phys = buddy_alloc_pages(0, BUDDY_FLAG_ZERO);
+    if (!phys) return E_NOMEM;
+
+    if (vmm_map_page(addr, phys, PAGE_PRESENT | PAGE_WRITE) != E_OK) {
+        buddy_free_pages(phys);
+        return E_NOMEM;
+    }
+
+    phys_to_page(phys)->owner = PAGE_OWNER_VMALLOC;
+    vmalloc_mapped_pages++;
+    return E_OK;
+}
+
+static vm_region_t vmalloc_region = {
+    .name = "vmalloc",
+    .start = VMALLOC_START,
+    .end = VMALLOC_START + VMALLOC_SIZE,
+    .fault = vmalloc_fault,
+};
+
+kerr_t vmalloc_init(void) {
+    memset(used_bitmap, 0, sizeof(used_bitmap));
+    memset(end_bitmap, 0, sizeof(end_bitmap));
+    memset(lazy_bitmap, 0, sizeof(lazy_bitmap));
+
+    kerr_t err = vmm_register_region(&vmalloc_region);
+    if (err != E_OK) return err;
+
+    serial_debug_puts("[VMALLOC] Window at 0x");
+    serial_puthex(COM1, VMALLOC_START, 16);
+    serial_debug_puts(", ");
+    char num_str[21];
+    uitoa(VMALLOC_SIZE / (1024 * 1024), num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(" MB\n");
+
+    return E_OK;
+}
+
+void* vmalloc(size_t size) {
+    return vmalloc_area(size, 0);
+}
+
+void* vzalloc(size_t size) {
+    return vmalloc_area(size, 1);
+}
+
+void* vmalloc_lazy(size_t size) {
+    if (size == 0) return NULL;
+    vmalloc_calls++;
+
+    uint64_t span = PAGE_ALIGN_UP((uint64_t)size) / PAGE_SIZE + VMALLOC_GUARD_PAGES;
+    uint64_t start = span <= VMALLOC_PAGES ? reserve_range(span, 1, 0, 1) : VMALLOC_PAGES;
+    if (start >= VMALLOC_PAGES) {
+        vmalloc_failures++;
+        return NULL;
+    }
+
+    return (void*)(VMALLOC_START + start * PAGE_SIZE);
+}
+
+// Take down the area at addr, name is the caller for the warning
+static void release_area(void* addr, const char* name) {
+    uint64_t index = area_index(addr);
+    if (index >= VMALLOC_PAGES) {
+        serial_debug_puts("[VMALLOC] Warning: ");
+        serial_debug_puts(name);
+        serial_debug_puts("() of pointer not from vmalloc: 0x");
+        serial_puthex(COM1, (uint64_t)addr, 16);
+        serial_debug_putc('\n');
+        return;
+    }
+
+    uint64_t span = area_span(index);
+    if (unmap_pages((uint64_t)addr, span - VMALLOC_GUARD_PAGES, area_owns_frames(index)) != E_OK) {
+        // Part of it is still mapped: keep the window reserved
+        serial_debug_puts("[VMALLOC] Warning: ");
+        serial_debug_puts(name);
+        serial_debug_puts("() could not unmap all of 0x");
+        serial_puthex(COM1, (uint64_t)addr, 16);
+        serial_debug_puts(", leaking the area\n");
+        return;
+    }
+    release_range(index, span);
+}
+
+void vfree(void* addr) {
+    if (!addr) return;
+
+    release_area(addr, "vfree");
+    vfree_calls++;
+}
+
+// Reserve an area for pages and map it to phys_pages[] or, without a list,
+// to the contiguous frames at phys_addr
+static void* vmap_area(uint64_t pages, uint64_t align, uint64_t phase, uint64_t phys_addr,
+                       const uint64_t* phys_pages, uint64_t flags) {
+    uint64_t span = pages + VMALLOC_GUARD_PAGES;
+    if (pages == 0 || span > VMALLOC_PAGES) return NULL;
+
+    uint64_t start = reserve_range(span, align, phase, 0);
+    if (start >= VMALLOC_PAGES) return NULL;
+
+    uint64_t virt = VMALLOC_START + start * PAGE_SIZE;
+    kerr_t err = phys_pages ? vmm_map_pages(virt, phys_pages, pages, flags)
+                            : vmm_map_range(virt, phys_addr, pages, flags);
+    if (err != E_OK) {
+        vmm_unmap_range(virt, pages, NULL);
+        release_range(start, span);
+        return NULL;
+    }
+
+    return (void*)virt;
+}
+
+void* vmap(const uint64_t* phys_pages, uint64_t count, uint64_t flags) {
+    if (!phys_pages) return NULL;
+
+    return vmap_area(count, 1, 0, 0, phys_pages, flags);
+}
+
+void* vmap_range(uint64_t phys_addr, size_t size, uint64_t flags) {
+    if (!IS_PAGE_ALIGNED(phys_addr)) return NULL;
+
+    // Give the area the same offset within 2MB as the frames, so every
+    // aligned 2MB span inside it can be mapped by one huge entry
+    uint64_t align = 1, phase = 0;
+    if (size >= VMM_PAGE_SIZE_2M) {
+        align = VMM_PAGE_SIZE_2M / PAGE_SIZE;
+        phase = (phys_addr / PAGE_SIZE) % align;
+    }
+
+    return vmap_area(PAGE_ALIGN_UP((uint64_t)size) / PAGE_SIZE, align, phase, phys_addr, NULL, flags);
+}
+
+void vunmap(void* addr) {
+    if (!addr) return;
+
+    release_area(addr, "vunmap");
+}
+
+size_t vmalloc_size(const void* addr) {
+    uint64_t index = area_index(addr);
+    if (index >= VMALLOC_PAGES) return 0;
+
+    return (area_span(index) - VMALLOC_GUARD_PAGES) * PAGE_SIZE;
+}
+
+void vmalloc_print_stats(void) {
+    // Largest free range left in the window
+    uint64_t largest = 0;
+    uint64_t run = 0;
+    for (uint64_t i = 0; i < VMALLOC_PAGES; i++) {
+        if (window_test(used_bitmap, i)) {
+            run = 0;
+        } else if (++run > largest) {
+            largest = run;
+        }
+    }
+
+    char num_str[21];
+    console_puts("=== vmalloc ===\n");
+    console_puts("Window:         ");
+    uitoa(VMALLOC_SIZE / (1024 * 1024), num_str);
+    console_puts(num_str);
+    console_puts(" MB\n");
+
+    console_puts("Areas:          ");
+    uitoa(vmalloc_areas, num_str);
+    console_puts(num_str);
+    console_puts(" (");
+    uitoa(vmalloc_reserved_pages * PAGE_SIZE / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB reserved, ");
+    uitoa(vmalloc_mapped_pages * PAGE_SIZE / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB mapped)\n");
+
+    console_puts("Largest free:   ");
+    uitoa(largest * PAGE_SIZE / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB\n");
+
+    console_puts("vmalloc/vfree:  ");
+    uitoa(vmalloc_calls, num_str);
+    console_puts(num_str);
+    console_puts(" / ");
+    uitoa(vfree_calls, num_str);
+    console_puts(num_str);
+    console_puts("  (failed ");
+    uitoa(vmalloc_failures, num_str);
+    console_puts(num_str);
+    console_puts(")\n");
+}
@@ -0,0 +1,64 @@
+#ifndef VMALLOC_H
+#define VMALLOC_H
+
+#include "libc/stdint.h"
+#include "libc/stddef.h"
+#include "error_handling/errno.h"
+#include "memory_layout.h"
+
+// vmalloc - virtually contiguous kernel memory in the VIRT_HEAP_BASE window.
+// Each page is allocated from the buddy allocator on its own and mapped with
+// vmm_map_pages(), so large buffers only need enough free pages, not a free
+// contiguous block. A bitmap with one bit per window page tracks which
+// virtual ranges are reserved. The window is registered as a demand-paged
+// VMM region for vmalloc_lazy() areas.
+
+#define VMALLOC_START       VIRT_HEAP_BASE
+#define VMALLOC_SIZE        VIRT_HEAP_SIZE
+#define VMALLOC_PAGES       (VMALLOC_SIZE / PAGE_SIZE)
+
+// Unmapped pages left after each area, so an overrun faults instead of
+// running into the next allocation
+#define VMALLOC_GUARD_PAGES 1
+
+// Reset the range allocator (the window starts out unmapped)
+kerr_t vmalloc_init(void);
+
+// Allocate size bytes (rounded up to pages), NULL if out of memory or window
+void* vmalloc(size_t size);
+
+// vmalloc() with the pages zeroed
+void* vzalloc(size_t size);
+
+// Reserve size bytes without allocating anything. Each page gets a zeroed
+// frame from the page fault handler the first time it is touched, so large
+// sparse buffers cost only what is actually used. Not for memory the fault
+// path itself uses (buddy allocator, page tables).
+void* vmalloc_lazy(size_t size);
+
+// Unmap and free an area returned by vmalloc() or vmalloc_lazy()
+void vfree(void* addr);
+
+// Map count frames listed in phys_pages into the window with 4KB pages
+void* vmap(const uint64_t* phys_pages, uint64_t count, uint64_t flags);
+
+// Map size bytes of physically contiguous memory at phys_addr (page aligned)
+// into the window with the given PTE flags. Areas of 2MB or more are placed
+// so the VMM can use 2MB pages for them.
+void* vmap_range(uint64_t phys_addr, size_t size, uint64_t flags);
+
+// Unmap an area returned by vmap() or vmap_range(); the frames are left alone
+void vunmap(void* addr);
+
+// Check if an address lies in the vmalloc window
+static inline int is_vmalloc_addr(const void* addr) {
+    return (uint64_t)addr >= VMALLOC_START && (uint64_t)addr < VMALLOC_START + VMALLOC_SIZE;
+}
+
+// Usable size of the area starting at addr (0 if addr is not an area start)
+size_t vmalloc_size(const void* addr);
+
+// Print window usage
+void vmalloc_print_stats(void);
+
+#endif
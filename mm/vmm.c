@@ -4,6 +4,8 @@
 #include "io/serial.h"
 #include "libc/string.h"
 #include "interrupts/idt.h"
+#include "cpu/cpu.h"
+#include "boot/multiboot2.h"
 
 // Page table entry indices from virtual address
 #define PML4_INDEX(addr) (((addr) >> 39) & 0x1FF)
@@ -11,151 +13,483 @@
 #define PD_INDEX(addr)   (((addr) >> 21) & 0x1FF)
 #define PT_INDEX(addr)   (((addr) >> 12) & 0x1FF)
 
+// First PML4 slot of the kernel half, shared by every address space
+#define PML4_KERNEL_FIRST 256
+
 // Current page table root (physical address)
 static uint64_t current_pml4_phys = 0;
 
-// FIXED: Get pointer to page table with fallback for boot tables
+// The boot page tables; every other space shares their kernel half
+static vmm_space_t kernel_space;
+static vmm_space_t* current_space = &kernel_space;
+
+// Bumped whenever a kernel-half PML4 entry is added
+static uint64_t kernel_gen = 0;
+
+// PCIDs: supported (CR4.PCIDE set), used for switches, and which are taken
+static int pcid_supported = 0;
+static int pcid_enabled = 0;
+static uint64_t pcid_bitmap[VMM_MAX_PCIDS / 64];
+static uint64_t live_spaces = 0;
+static uint64_t space_switches = 0;
+
+// CPUID says 1GB pages (pdpe1gb) are available
+static int gbpages = 0;
+
+// Statistics
+static uint64_t huge_maps_2m = 0;
+static uint64_t huge_maps_1g = 0;
+static uint64_t huge_splits = 0;
+
+// Demand-paged regions, searched by the page fault handler
+static vm_region_t* regions = NULL;
+
+// Set while a region's fault callback runs, a fault inside it is fatal
+static int in_region_fault = 0;
+
+// Page tables are reached through the direct map, which covers every frame
+// the PMM hands out as well as the boot tables in low memory
 static inline uint64_t* get_table(uint64_t phys_addr) {
-    // Check if in direct map region (above 4MB)
-    if (phys_addr >= PHYS_FREE_START) {
-        return (uint64_t*)PHYS_TO_VIRT(phys_addr);
+    return (uint64_t*)PHYS_TO_VIRT(phys_addr);
+}
+
+// Page directories for direct-mapping RAM above 1GB with 2MB pages when the
+// CPU has no 1GB pages. vmm_init() runs before the PMM, so they are static.
+#define DIRECT_MAP_POOL_PDS 15
+static uint64_t direct_map_pds[DIRECT_MAP_POOL_PDS][512] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t direct_map_pds_used = 0;
+
+// PHYS_TO_VIRT is valid for all RAM below this
+static uint64_t direct_map_end = PHYS_DIRECT_MAP_BOOT_END;
+
+// Map the 1GB (or 2MB) chunk of RAM holding phys into the direct map
+// Returns 0 if a page directory was needed and the pool is used up
+static int direct_map_chunk(uint64_t* pdpt, uint64_t phys) {
+    uint64_t* pdpte = &pdpt[PDPT_INDEX(phys)];
+
+    if (gbpages) {
+        if (!(*pdpte & PAGE_PRESENT)) {
+            *pdpte = (phys & ~(VMM_PAGE_SIZE_1G - 1)) | PAGE_PRESENT | PAGE_WRITE | PAGE_HUGE;
+            huge_maps_1g++;
+        }
+        return 1;
+    }
+
+    if (!(*pdpte & PAGE_PRESENT)) {
+        if (direct_map_pds_used == DIRECT_MAP_POOL_PDS) return 0;
+
+        uint64_t* pd = direct_map_pds[direct_map_pds_used++];
+        *pdpte = KERNEL_VIRT_TO_PHYS(pd) | PAGE_PRESENT | PAGE_WRITE;
+    } else if (*pdpte & PAGE_HUGE) {
+        return 1;
+    }
+
+    uint64_t* pd = get_table(pte_get_address(*pdpte));
+    uint64_t* pde = &pd[PD_INDEX(phys)];
+    if (!(*pde & PAGE_PRESENT)) {
+        *pde = (phys & ~(VMM_PAGE_SIZE_2M - 1)) | PAGE_PRESENT | PAGE_WRITE | PAGE_HUGE;
+        huge_maps_2m++;
+    }
+    return 1;
+}
+
+// boot.asm only maps the first 1GB of the direct map. Map every available
+// memory map region above that, skipping holes, so PHYS_TO_VIRT works for
+// all of RAM. New entries were not present before, so nothing to flush.
+static void extend_direct_map(void) {
+    uint32_t region_count = 0;
+    const memory_region_t* map = multiboot2_get_regions(&region_count);
+
+    uint64_t* pml4 = get_table(current_pml4_phys);
+    uint64_t* pdpt = get_table(pte_get_address(pml4[PML4_INDEX(VIRT_PHYS_MAP_BASE)]));
+    uint64_t step = gbpages ? VMM_PAGE_SIZE_1G : VMM_PAGE_SIZE_2M;
+
+    for (uint32_t i = 0; i < region_count; i++) {
+        if (map[i].type != MULTIBOOT2_MEMORY_AVAILABLE) continue;
+
+        uint64_t start = map[i].base & ~(step - 1);
+        uint64_t end = map[i].base + map[i].length;
+        if (start < PHYS_DIRECT_MAP_BOOT_END) start = PHYS_DIRECT_MAP_BOOT_END;
+        if (end > VIRT_PHYS_MAP_SIZE) end = VIRT_PHYS_MAP_SIZE;
+
+        for (uint64_t phys = start; phys < end; phys += step) {
+            if (!direct_map_chunk(pdpt, phys)) {
+                // Regions are sorted, nothing past here gets mapped
+                serial_debug_puts("[VMM] Out of direct map page directories at 0x");
+                serial_puthex(COM1, phys, 16);
+                serial_debug_putc('\n');
+                if (phys > direct_map_end) direct_map_end = phys;
+                return;
+            }
+        }
+
+        if (end > direct_map_end) direct_map_end = end;
     }
-    // Fallback for boot tables in low memory (they're identity mapped)
-    return (uint64_t*)phys_addr;
 }
 
 kerr_t vmm_init(void) {
     //Get current CR3
     uint64_t cr3;
     asm volatile("mov %%cr3, %0" : "=r"(cr3));
-    current_pml4_phys = cr3;
+    current_pml4_phys = PAGE_ALIGN_DOWN(cr3);
+    kernel_space.pml4_phys = current_pml4_phys;
+    kernel_space.pcid = 0;
 
     serial_debug_puts("[VMM] Current PML4 at: ");
     serial_puthex(COM1, current_pml4_phys, 16);
     serial_debug_puts("\n");
 
+    gbpages = cpu_has_gbpages();
+    serial_debug_puts(gbpages ? "[VMM] 1GB pages supported\n" : "[VMM] 1GB pages not supported\n");
+
+    // CR4.PCIDE can only be set while CR3 holds PCID 0, which it does at boot
+    if (cpu_has_pcid() && (cr3 & ~PAGE_MASK) == 0) {
+        write_cr4(read_cr4() | CR4_PCIDE);
+        pcid_supported = 1;
+        pcid_enabled = 1;
+        pcid_bitmap[0] = 1;     // PCID 0 is the kernel space
+    }
+    serial_debug_puts(pcid_supported ? "[VMM] PCID enabled\n" : "[VMM] PCID not supported\n");
+
+    extend_direct_map();
+    serial_debug_puts("[VMM] Direct map covers RAM up to 0x");
+    serial_puthex(COM1, direct_map_end, 16);
+    serial_debug_putc('\n');
+
     return E_OK;
 }
 
-kerr_t vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
-    if (!IS_PAGE_ALIGNED(virt_addr) || !IS_PAGE_ALIGNED(phys_addr)) return E_INVALID;
+uint64_t vmm_get_direct_map_end(void) {
+    return direct_map_end;
+}
 
-    //Get indices
-    uint16_t pml4_i = PML4_INDEX(virt_addr);
-    uint16_t pdpt_i = PDPT_INDEX(virt_addr);
-    uint16_t pd_i = PD_INDEX(virt_addr);
-    uint16_t pt_i = PT_INDEX(virt_addr);
+// Pages covered by one PD (2MB), PDPT (1GB) and PML4 (512GB) entry
+#define PAGES_PER_2M   (VMM_PAGE_SIZE_2M / PAGE_SIZE)
+#define PAGES_PER_1G   (VMM_PAGE_SIZE_1G / PAGE_SIZE)
+#define PAGES_PER_512G (PAGES_PER_1G * 512)
 
-    //Get PML4
-    uint64_t* pml4 = get_table(current_pml4_phys);
+// Replace a huge entry with a table of 512 entries of child_size mapping the
+// same memory. The caller flushes once it has changed the pages it split for.
+static kerr_t split_huge(uint64_t* entry, uint64_t child_size) {
+    uint64_t table_phys = pmm_alloc_page();
+    if (!table_phys) return E_NOMEM;
 
-    // Get or create PDPT
-    uint64_t* pdpt;
-    if (!(pml4[pml4_i] & PAGE_PRESENT)) {
-        uint64_t pdpt_phys = pmm_alloc_page();
-        if (!pdpt_phys) return E_NOMEM;
+    uint64_t* table = get_table(table_phys);
+    uint64_t base = pte_get_address(*entry);
+    uint64_t flags = *entry & ~pte_get_address(*entry);
 
-        pdpt = get_table(pdpt_phys);
-        memset(pdpt, 0, PAGE_SIZE);
+    // Bit 7 means PAT, not huge, in a 4KB PTE
+    if (child_size == PAGE_SIZE) flags &= ~PAGE_HUGE;
 
-        pml4[pml4_i] = pdpt_phys | PAGE_PRESENT | PAGE_WRITE;
-    } else {
-        pdpt = get_table(pte_get_address(pml4[pml4_i]));
+    for (uint64_t i = 0; i < 512; i++) {
+        table[i] = (base + i * child_size) | flags;
     }
 
-    // Get or create PD
-    uint64_t* pd;
-    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) {
-        uint64_t pd_phys = pmm_alloc_page();
-        if (!pd_phys) return E_NOMEM;
+    *entry = table_phys | PAGE_PRESENT | PAGE_WRITE;
+    huge_splits++;
+    return E_OK;
+}
 
-        pd = get_table(pd_phys);
-        memset(pd, 0, PAGE_SIZE);
+// Follow one page table entry down a level. With create set, a missing table
+// is allocated and a huge entry is split into 512 entries of child_size.
+static kerr_t next_table(uint64_t* entry, int create, uint64_t child_size, uint64_t** table) {
+    if (!(*entry & PAGE_PRESENT)) {
+        if (!create) return E_NOTFOUND;
 
-        pdpt[pdpt_i] = pd_phys | PAGE_PRESENT | PAGE_WRITE;
-    } else {
-        pd = get_table(pte_get_address(pdpt[pdpt_i]));
+        uint64_t table_phys = pmm_alloc_zeroed_page();
+        if (!table_phys) return E_NOMEM;
+
+        *entry = table_phys | PAGE_PRESENT | PAGE_WRITE;
+    } else if (*entry & PAGE_HUGE) {
+        if (!create) return E_INVALID;
+
+        kerr_t err = split_huge(entry, child_size);
+        if (err != E_OK) return err;
     }
 
-    // Get or create PT
-    uint64_t* pt;
-    if (!(pd[pd_i] & PAGE_PRESENT)) {
-        uint64_t pt_phys = pmm_alloc_page();
-        if (!pt_phys) return E_NOMEM;
+    *table = get_table(pte_get_address(*entry));
+    return E_OK;
+}
 
-        pt = get_table(pt_phys);
-        memset(pt, 0, PAGE_SIZE);
+// A huge entry of size fits if both addresses are aligned to it and no
+// existing page table would be thrown away
+static inline int huge_fits(uint64_t virt, uint64_t phys, uint64_t size, uint64_t entry) {
+    return ((virt | phys) & (size - 1)) == 0 && (!(entry & PAGE_PRESENT) || (entry & PAGE_HUGE));
+}
 
-        pd[pd_i] = pt_phys | PAGE_PRESENT | PAGE_WRITE;
-    } else {
-        pt = get_table(pte_get_address(pd[pd_i]));
+// Pages from virt_addr to the end of the entry covering pages_per_entry pages
+static inline uint64_t pages_to_boundary(uint64_t virt_addr, uint64_t pages_per_entry) {
+    return pages_per_entry - ((virt_addr / PAGE_SIZE) & (pages_per_entry - 1));
+}
+
+// PML4 that maps virt_addr: kernel-half addresses always use the kernel's
+static inline uint64_t* root_table(uint64_t virt_addr) {
+    if (PML4_INDEX(virt_addr) >= PML4_KERNEL_FIRST) return get_table(kernel_space.pml4_phys);
+    return get_table(current_pml4_phys);
+}
+
+// Invalidate count pages from virt_addr after their PTEs changed
+static void flush_range(uint64_t virt_addr, uint64_t count) {
+    // Kernel-half entries may be cached under any space's PCID
+    if (pcid_supported && live_spaces > 0 && PML4_INDEX(virt_addr) >= PML4_KERNEL_FIRST) {
+        invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+        return;
     }
 
-    // Map the page
-    pt[pt_i] = phys_addr | flags;
+    if (count > VMM_INVLPG_MAX) {
+        vmm_flush_tlb();
+        return;
+    }
 
-    // Flush TLB for this page
-    vmm_flush_tlb_page(virt_addr);
+    for (uint64_t i = 0; i < count; i++) {
+        vmm_flush_tlb_page(virt_addr + i * PAGE_SIZE);
+    }
+}
 
-    return E_OK;
+// Shared by the range mappers: phys_pages[i] if given, else phys_addr + i pages.
+// Physically contiguous ranges use 1GB/2MB entries wherever alignment allows.
+static kerr_t map_range(uint64_t virt_addr, uint64_t phys_addr, const uint64_t* phys_pages,
+                        uint64_t count, uint64_t flags) {
+    if (!IS_PAGE_ALIGNED(virt_addr) || !IS_PAGE_ALIGNED(phys_addr)) return E_INVALID;
+
+    uint64_t* pml4 = root_table(virt_addr);
+
+    // Only entries that were already present can be cached in the TLB
+    int replaced = 0;
+    uint64_t done = 0;
+    kerr_t err = E_OK;
+
+    while (done < count) {
+        uint64_t virt = virt_addr + done * PAGE_SIZE;
+        uint64_t phys = phys_pages ? phys_pages[done] : phys_addr + done * PAGE_SIZE;
+        uint64_t left = count - done;
+
+        uint64_t* pdpt;
+        uint64_t* pml4e = &pml4[PML4_INDEX(virt)];
+        int new_pdpt = !(*pml4e & PAGE_PRESENT);
+        err = next_table(pml4e, 1, VMM_PAGE_SIZE_1G, &pdpt);
+        if (err != E_OK) break;
+
+        // Hand a new kernel-half PDPT to the current space now, others on switch
+        if (new_pdpt && PML4_INDEX(virt) >= PML4_KERNEL_FIRST) {
+            kernel_gen++;
+            get_table(current_pml4_phys)[PML4_INDEX(virt)] = *pml4e;
+            current_space->kernel_gen = kernel_gen;
+        }
+
+        uint64_t* pdpte = &pdpt[PDPT_INDEX(virt)];
+        if (!phys_pages && gbpages && left >= PAGES_PER_1G &&
+            huge_fits(virt, phys, VMM_PAGE_SIZE_1G, *pdpte)) {
+            if (*pdpte & PAGE_PRESENT) replaced = 1;
+            *pdpte = phys | flags | PAGE_HUGE;
+            huge_maps_1g++;
+            done += PAGES_PER_1G;
+            continue;
+        }
+
+        uint64_t* pd;
+        err = next_table(pdpte, 1, VMM_PAGE_SIZE_2M, &pd);
+        if (err != E_OK) break;
+
+        uint64_t* pde = &pd[PD_INDEX(virt)];
+        if (!phys_pages && left >= PAGES_PER_2M &&
+            huge_fits(virt, phys, VMM_PAGE_SIZE_2M, *pde)) {
+            if (*pde & PAGE_PRESENT) replaced = 1;
+            *pde = phys | flags | PAGE_HUGE;
+            huge_maps_2m++;
+            done += PAGES_PER_2M;
+            continue;
+        }
+
+        uint64_t* pt;
+        err = next_table(pde, 1, PAGE_SIZE, &pt);
+        if (err != E_OK) break;
+
+        // Fill PTEs up to the end of this page table
+        for (uint16_t i = PT_INDEX(virt); i < 512 && done < count; i++, done++) {
+            phys = phys_pages ? phys_pages[done] : phys_addr + done * PAGE_SIZE;
+            if (pt[i] & PAGE_PRESENT) replaced = 1;
+            pt[i] = phys | flags;
+        }
+    }
+
+    if (replaced) flush_range(virt_addr, done);
+
+    return err;
 }
 
-kerr_t vmm_unmap_page(uint64_t virt_addr) {
-    if (!IS_PAGE_ALIGNED(virt_addr)) {
-        return E_INVALID;
+kerr_t vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags) {
+    return map_range(virt_addr, phys_addr, NULL, 1, flags);
+}
+
+kerr_t vmm_map_range(uint64_t virt_addr, uint64_t phys_addr, uint64_t count, uint64_t flags) {
+    return map_range(virt_addr, phys_addr, NULL, count, flags);
+}
+
+kerr_t vmm_map_pages(uint64_t virt_addr, const uint64_t* phys_pages, uint64_t count, uint64_t flags) {
+    for (uint64_t i = 0; i < count; i++) {
+        if (!IS_PAGE_ALIGNED(phys_pages[i])) return E_INVALID;
     }
 
-    uint16_t pml4_i = PML4_INDEX(virt_addr);
-    uint16_t pdpt_i = PDPT_INDEX(virt_addr);
-    uint16_t pd_i = PD_INDEX(virt_addr);
-    uint16_t pt_i = PT_INDEX(virt_addr);
+    return map_range(virt_addr, 0, phys_pages, count, flags);
+}
 
-    uint64_t* pml4 = get_table(current_pml4_phys);
-    if (!(pml4[pml4_i] & PAGE_PRESENT)) return E_NOTFOUND;
+// Clear a huge entry that lies entirely inside the range being unmapped
+static void unmap_huge(uint64_t* entry, uint64_t pages, uint64_t* phys_pages) {
+    uint64_t base = pte_get_address(*entry);
+    if (phys_pages) {
+        for (uint64_t i = 0; i < pages; i++) {
+            phys_pages[i] = base + i * PAGE_SIZE;
+        }
+    }
+    *entry = 0;
+}
 
-    uint64_t* pdpt = get_table(pte_get_address(pml4[pml4_i]));
-    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) return E_NOTFOUND;
+// Shared by the unmappers: *unmapped receives how many pages were mapped.
+// E_NOMEM if splitting a huge page failed, the rest then stays mapped.
+static kerr_t unmap_range(uint64_t virt_addr, uint64_t count, uint64_t* phys_pages,
+                          uint64_t* unmapped_out) {
+    *unmapped_out = 0;
+    if (!IS_PAGE_ALIGNED(virt_addr)) return E_INVALID;
+
+    uint64_t* pml4 = root_table(virt_addr);
+    uint64_t unmapped = 0;
+    uint64_t done = 0;
+
+    while (done < count) {
+        uint64_t virt = virt_addr + done * PAGE_SIZE;
+        uint64_t left = count - done;
+        uint64_t skip;
+
+        uint64_t* pdpt;
+        uint64_t* pd;
+        uint64_t* pt;
+
+        if (next_table(&pml4[PML4_INDEX(virt)], 0, VMM_PAGE_SIZE_1G, &pdpt) != E_OK) {
+            skip = pages_to_boundary(virt, PAGES_PER_512G);
+            goto not_mapped;
+        }
+
+        uint64_t* pdpte = &pdpt[PDPT_INDEX(virt)];
+        if (!(*pdpte & PAGE_PRESENT)) {
+            skip = pages_to_boundary(virt, PAGES_PER_1G);
+            goto not_mapped;
+        }
+        if ((*pdpte & PAGE_HUGE) && pages_to_boundary(virt, PAGES_PER_1G) == PAGES_PER_1G &&
+            left >= PAGES_PER_1G) {
+            unmap_huge(pdpte, PAGES_PER_1G, phys_pages ? &phys_pages[done] : NULL);
+            unmapped += PAGES_PER_1G;
+            done += PAGES_PER_1G;
+            continue;
+        }
+
+        // Only part of a 1GB page goes away: split it and carry on below
+        if (next_table(pdpte, 1, VMM_PAGE_SIZE_2M, &pd) != E_OK) break;
+
+        uint64_t* pde = &pd[PD_INDEX(virt)];
+        if (!(*pde & PAGE_PRESENT)) {
+            skip = pages_to_boundary(virt, PAGES_PER_2M);
+            goto not_mapped;
+        }
+        if ((*pde & PAGE_HUGE) && pages_to_boundary(virt, PAGES_PER_2M) == PAGES_PER_2M &&
+            left >= PAGES_PER_2M) {
+            unmap_huge(pde, PAGES_PER_2M, phys_pages ? &phys_pages[done] : NULL);
+            unmapped += PAGES_PER_2M;
+            done += PAGES_PER_2M;
+            continue;
+        }
+
+        if (next_table(pde, 1, PAGE_SIZE, &pt) != E_OK) break;
+
+        for (uint16_t i = PT_INDEX(virt); i < 512 && done < count; i++, done++) {
+            uint64_t phys = 0;
+            if (pt[i] & PAGE_PRESENT) {
+                phys = pte_get_address(pt[i]);
+                pt[i] = 0;
+                unmapped++;
+            }
+            if (phys_pages) phys_pages[done] = phys;
+        }
+        continue;
+
+    not_mapped:
+        if (skip > left) skip = left;
+        if (phys_pages) memset(&phys_pages[done], 0, skip * sizeof(uint64_t));
+        done += skip;
+    }
 
-    uint64_t* pd = get_table(pte_get_address(pdpt[pdpt_i]));
-    if (!(pd[pd_i] & PAGE_PRESENT)) return E_NOTFOUND;
+    // A split failed for lack of memory, the rest stays mapped
+    if (done < count && phys_pages) {
+        memset(&phys_pages[done], 0, (count - done) * sizeof(uint64_t));
+    }
 
-    uint64_t* pt = get_table(pte_get_address(pd[pd_i]));
-    if (!(pt[pt_i] & PAGE_PRESENT)) return E_NOTFOUND;
+    if (unmapped) flush_range(virt_addr, count);
 
-    pt[pt_i] = 0;
-    vmm_flush_tlb_page(virt_addr);
+    *unmapped_out = unmapped;
+    return done < count ? E_NOMEM : E_OK;
+}
 
-    return E_OK;
+uint64_t vmm_unmap_range(uint64_t virt_addr, uint64_t count, uint64_t* phys_pages) {
+    uint64_t unmapped;
+    unmap_range(virt_addr, count, phys_pages, &unmapped);
+    return unmapped;
 }
 
-uint64_t vmm_get_physical(uint64_t virt_addr) {
-    uint16_t pml4_i = PML4_INDEX(virt_addr);
-    uint16_t pdpt_i = PDPT_INDEX(virt_addr);
-    uint16_t pd_i = PD_INDEX(virt_addr);
-    uint16_t pt_i = PT_INDEX(virt_addr);
+kerr_t vmm_unmap_range_all(uint64_t virt_addr, uint64_t count, uint64_t* phys_pages) {
+    uint64_t unmapped;
+    return unmap_range(virt_addr, count, phys_pages, &unmapped);
+}
 
-    uint64_t* pml4 = get_table(current_pml4_phys);
-    if (!(pml4[pml4_i] & PAGE_PRESENT)) return 0;
+kerr_t vmm_unmap_page(uint64_t virt_addr) {
+    if (!IS_PAGE_ALIGNED(virt_addr)) {
+        return E_INVALID;
+    }
 
-    uint64_t* pdpt = get_table(pte_get_address(pml4[pml4_i]));
-    if (!(pdpt[pdpt_i] & PAGE_PRESENT)) return 0;
+    return vmm_unmap_range(virt_addr, 1, NULL) ? E_OK : E_NOTFOUND;
+}
 
-    uint64_t* pd = get_table(pte_get_address(pdpt[pdpt_i]));
-    if (!(pd[pd_i] & PAGE_PRESENT)) return 0;
+// Entry that maps virt_addr (PTE, or a huge PD/PDPT entry) and the page size it maps
+static uint64_t* leaf_entry(uint64_t virt_addr, uint64_t* size) {
+    uint64_t* pml4 = root_table(virt_addr);
+    if (!(pml4[PML4_INDEX(virt_addr)] & PAGE_PRESENT)) return NULL;
+
+    uint64_t* pdpt = get_table(pte_get_address(pml4[PML4_INDEX(virt_addr)]));
+    uint64_t* pdpte = &pdpt[PDPT_INDEX(virt_addr)];
+    if (!(*pdpte & PAGE_PRESENT)) return NULL;
+    if (*pdpte & PAGE_HUGE) {
+        *size = VMM_PAGE_SIZE_1G;
+        return pdpte;
+    }
 
-    // Check for 2MB huge page
-    if (pd[pd_i] & PAGE_HUGE) {
-        uint64_t phys_base = pte_get_address(pd[pd_i]);
-        uint64_t offset = virt_addr & 0x1FFFFF;  // 2MB offset
-        return phys_base + offset;
+    uint64_t* pd = get_table(pte_get_address(*pdpte));
+    uint64_t* pde = &pd[PD_INDEX(virt_addr)];
+    if (!(*pde & PAGE_PRESENT)) return NULL;
+    if (*pde & PAGE_HUGE) {
+        *size = VMM_PAGE_SIZE_2M;
+        return pde;
     }
 
-    uint64_t* pt = get_table(pte_get_address(pd[pd_i]));
-    if (!(pt[pt_i] & PAGE_PRESENT)) return 0;
+    uint64_t* pt = get_table(pte_get_address(*pde));
+    uint64_t* pte = &pt[PT_INDEX(virt_addr)];
+    if (!(*pte & PAGE_PRESENT)) return NULL;
+
+    *size = PAGE_SIZE;
+    return pte;
+}
+
+uint64_t vmm_get_physical(uint64_t virt_addr) {
+    uint64_t size;
+    uint64_t* entry = leaf_entry(virt_addr, &size);
+    if (!entry) return 0;
+
+    // Huge entries keep their PAT bit at bit 12, below the page address
+    uint64_t phys_base = pte_get_address(*entry) & ~(size - 1);
+    return phys_base + (virt_addr & (size - 1));
+}
 
-    uint64_t phys_base = pte_get_address(pt[pt_i]);
-    uint64_t offset = virt_addr & 0xFFF;  // 4KB offset
-    return phys_base + offset;
+uint64_t vmm_get_page_size(uint64_t virt_addr) {
+    uint64_t size;
+    return leaf_entry(virt_addr, &size) ? size : 0;
 }
 
 int vmm_is_mapped(uint64_t virt_addr) {
@@ -190,6 +524,126 @@ uint64_t vmm_get_cr3(void) {
     return current_pml4_phys;
 }
 
+kerr_t vmm_space_init(vmm_space_t* space) {
+    if (!space) return E_INVALID;
+
+    // Tag 0 stays with the kernel space, so running out is an error
+    uint16_t pcid = 0;
+    if (pcid_supported) {
+        uint64_t flags = irq_save();
+        for (uint32_t i = 0; i < VMM_MAX_PCIDS / 64 && !pcid; i++) {
+            if (pcid_bitmap[i] != ~0ULL) {
+                pcid = i * 64 + bit_scan_forward(~pcid_bitmap[i]);
+                pcid_bitmap[i] |= 1ULL << (pcid % 64);
+            }
+        }
+        irq_restore(flags);
+        if (!pcid) return E_NOMEM;
+    }
+
+    uint64_t pml4_phys = pmm_alloc_zeroed_page();
+    if (!pml4_phys) {
+        if (pcid) pcid_bitmap[pcid / 64] &= ~(1ULL << (pcid % 64));
+        return E_NOMEM;
+    }
+
+    uint64_t* pml4 = get_table(pml4_phys);
+    uint64_t* kernel_pml4 = get_table(kernel_space.pml4_phys);
+    pml4[0] = kernel_pml4[0];
+    memcpy(&pml4[PML4_KERNEL_FIRST], &kernel_pml4[PML4_KERNEL_FIRST],
+           (512 - PML4_KERNEL_FIRST) * sizeof(uint64_t));
+
+    space->pml4_phys = pml4_phys;
+    space->pcid = pcid;
+    space->kernel_gen = kernel_gen;
+    live_spaces++;
+
+    return E_OK;
+}
+
+// Free the table an entry points to and, above PT level, every table below it
+static void free_tables(uint64_t entry, int level) {
+    if (!(entry & PAGE_PRESENT) || (entry & PAGE_HUGE)) return;
+
+    uint64_t* table = get_table(pte_get_address(entry));
+    if (level > 1) {
+        for (uint32_t i = 0; i < 512; i++) {
+            free_tables(table[i], level - 1);
+        }
+    }
+    pmm_free_page(pte_get_address(entry));
+}
+
+void vmm_space_destroy(vmm_space_t* space) {
+    if (!space || !space->pml4_phys || space == &kernel_space) return;
+    if (space == current_space) {
+        serial_debug_puts("[VMM] Error: Cannot destroy the current address space\n");
+        return;
+    }
+
+    // Slot 0 and the kernel half belong to the kernel space
+    uint64_t* pml4 = get_table(space->pml4_phys);
+    for (uint32_t i = 1; i < PML4_KERNEL_FIRST; i++) {
+        free_tables(pml4[i], 3);
+    }
+    pmm_free_page(space->pml4_phys);
+
+    // Nothing tagged with the PCID may survive into its next owner
+    if (space->pcid) {
+        invpcid(INVPCID_CONTEXT, space->pcid, 0);
+
+        uint64_t flags = irq_save();
+        pcid_bitmap[space->pcid / 64] &= ~(1ULL << (space->pcid % 64));
+        irq_restore(flags);
+    }
+
+    space->pml4_phys = 0;
+    live_spaces--;
+}
+
+void vmm_switch_space(vmm_space_t* space) {
+    if (!space) space = &kernel_space;
+    if (space == current_space) return;
+
+    uint64_t flags = irq_save();
+
+    // Pick up kernel-half PDPTs added since this space last ran
+    if (space != &kernel_space && space->kernel_gen != kernel_gen) {
+        memcpy(&get_table(space->pml4_phys)[PML4_KERNEL_FIRST],
+               &get_table(kernel_space.pml4_phys)[PML4_KERNEL_FIRST],
+               (512 - PML4_KERNEL_FIRST) * sizeof(uint64_t));
+        space->kernel_gen = kernel_gen;
+    }
+
+    uint64_t cr3 = space->pml4_phys;
+    if (pcid_enabled) cr3 |= space->pcid | CR3_NOFLUSH;
+    asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+
+    current_space = space;
+    current_pml4_phys = space->pml4_phys;
+    space_switches++;
+
+    irq_restore(flags);
+}
+
+vmm_space_t* vmm_current_space(void) {
+    return current_space == &kernel_space ? NULL : current_space;
+}
+
+int vmm_pcid_supported(void) {
+    return pcid_supported;
+}
+
+void vmm_set_pcid(int enabled) {
+    if (!pcid_supported || enabled == pcid_enabled) return;
+
+    // Untagged switches run everything as PCID 0, so drop what both modes cached
+    uint64_t flags = irq_save();
+    pcid_enabled = enabled;
+    invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+    irq_restore(flags);
+}
+
 void vmm_flush_tlb_page(uint64_t virt_addr) {
     asm volatile("invlpg (%0)" :: "r"(virt_addr) : "memory");
 }
@@ -200,7 +654,104 @@ void vmm_flush_tlb(void) {
     asm volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
 }
 
+void vmm_print_stats(void) {
+    char num_str[21];
+    console_puts("=== VMM ===\n");
+    console_puts("1GB pages:      ");
+    console_puts(gbpages ? "supported\n" : "not supported\n");
+
+    console_puts("PCID:           ");
+    console_puts(!pcid_supported ? "not supported\n" : pcid_enabled ? "enabled\n" : "disabled\n");
+
+    console_puts("Address spaces: ");
+    uitoa(live_spaces + 1, num_str);
+    console_puts(num_str);
+    console_puts(" (");
+    uitoa(space_switches, num_str);
+    console_puts(num_str);
+    console_puts(" switches)\n");
+
+    char map_str[21];
+    console_puts("Direct map:     ");
+    uitoa(direct_map_end / (1024 * 1024), map_str);
+    console_puts(map_str);
+    console_puts(" MB\n");
+
+    console_puts("Huge mappings:  ");
+    uitoa(huge_maps_2m, num_str);
+    console_puts(num_str);
+    console_puts(" x 2MB, ");
+    uitoa(huge_maps_1g, num_str);
+    console_puts(num_str);
+    console_puts(" x 1GB (");
+    uitoa(huge_splits, num_str);
+    console_puts(num_str);
+    console_puts(" split)\n");
+
+    for (vm_region_t* r = regions; r; r = r->next) {
+        console_puts("Region ");
+        console_puts(r->name);
+        console_puts(": ");
+        uitoa(r->faults, num_str);
+        console_puts(num_str);
+        console_puts(" demand faults\n");
+    }
+}
+
+kerr_t vmm_register_region(vm_region_t* region) {
+    if (!region || !region->fault || region->start >= region->end ||
+        !IS_PAGE_ALIGNED(region->start) || !IS_PAGE_ALIGNED(region->end)) {
+        return E_INVALID;
+    }
+
+    for (vm_region_t* r = regions; r; r = r->next) {
+        if (r == region || (region->start < r->end && r->start < region->end)) return E_EXISTS;
+    }
+
+    region->faults = 0;
+    region->next = regions;
+    regions = region;
+
+    return E_OK;
+}
+
+void vmm_unregister_region(vm_region_t* region) {
+    vm_region_t** link = &regions;
+    while (*link) {
+        if (*link == region) {
+            *link = region->next;
+            region->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+static vm_region_t* find_region(uint64_t addr) {
+    for (vm_region_t* r = regions; r; r = r->next) {
+        if (addr >= r->start && addr < r->end) return r;
+    }
+    return NULL;
+}
+
 void page_fault_handler(uint64_t fault_addr, uint64_t error_code) {
+    // Kernel access to a page a region has not mapped yet
+    vm_region_t* region = NULL;
+    if (!(error_code & (PF_PRESENT | PF_USER | PF_RESERVED)) && !in_region_fault) {
+        region = find_region(fault_addr);
+    }
+
+    if (region) {
+        in_region_fault = 1;
+        kerr_t err = region->fault(region, PAGE_ALIGN_DOWN(fault_addr), error_code);
+        in_region_fault = 0;
+
+        if (err == E_OK) {
+            region->faults++;
+            return;
+        }
+    }
+
     console_puts("\n\n");
     console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
     console_puts("*** PAGE FAULT ***\n");
@@ -218,32 +769,38 @@ void page_fault_handler(uint64_t fault_addr, uint64_t error_code) {
     console_puts("\n\n");
 
     console_puts("Details:\n");
-    if (error_code & 0x1) {
+    if (error_code & PF_PRESENT) {
         console_puts("  - Page protection violation\n");
     } else {
         console_puts("  - Page not present\n");
     }
 
-    if (error_code & 0x2) {
+    if (error_code & PF_WRITE) {
         console_puts("  - Write access\n");
     } else {
         console_puts("  - Read access\n");
     }
 
-    if (error_code & 0x4) {
+    if (error_code & PF_USER) {
         console_puts("  - User mode\n");
     } else {
         console_puts("  - Kernel mode\n");
     }
 
-    if (error_code & 0x8) {
+    if (error_code & PF_RESERVED) {
         console_puts("  - Reserved bit violation\n");
     }
 
-    if (error_code & 0x10) {
+    if (error_code & PF_FETCH) {
         console_puts("  - Instruction fetch\n");
     }
 
+    if (region) {
+        console_puts("  - In region ");
+        console_puts(region->name);
+        console_puts(", not resolved\n");
+    }
+
     console_puts("\n");
     console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
     console_puts("System halted.\n");
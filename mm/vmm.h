@@ -7,19 +7,51 @@
 
 // Virtual memory manager - handles page table manipulation
 
-// Initialize VMM with current page tables
+// Initialize VMM with current page tables and extend the direct map over all
+// RAM in the memory map (1GB pages if supported, else 2MB). Runs before pmm_init().
 kerr_t vmm_init(void);
 
+// End of the physical memory PHYS_TO_VIRT can reach
+uint64_t vmm_get_direct_map_end(void);
+
 // Map a virtual page to a physical page with specified flags
 kerr_t vmm_map_page(uint64_t virt_addr, uint64_t phys_addr, uint64_t flags);
 
 // Unmap a virtual page
 kerr_t vmm_unmap_page(uint64_t virt_addr);
 
+// Range operations walk the tables once per page table (512 pages) and flush
+// the TLB once at the end: invlpg per page up to VMM_INVLPG_MAX pages, a CR3
+// reload above that. Mapping over non-present PTEs needs no flush at all.
+#define VMM_INVLPG_MAX 32
+
+// Huge page sizes (PD and PDPT entries with PAGE_HUGE)
+#define VMM_PAGE_SIZE_2M 0x200000ULL
+#define VMM_PAGE_SIZE_1G 0x40000000ULL
+
+// Map count pages at virt_addr to physically contiguous pages at phys_addr.
+// Spans where both addresses are 2MB (or, with CPU support, 1GB) aligned get a
+// single huge entry. Mapping or unmapping part of a huge page splits it.
+kerr_t vmm_map_range(uint64_t virt_addr, uint64_t phys_addr, uint64_t count, uint64_t flags);
+
+// Map count pages at virt_addr to the frames listed in phys_pages
+kerr_t vmm_map_pages(uint64_t virt_addr, const uint64_t* phys_pages, uint64_t count, uint64_t flags);
+
+// Unmap count pages at virt_addr, returns how many were mapped
+// If phys_pages is given it receives each page's frame (0 if it was not mapped)
+uint64_t vmm_unmap_range(uint64_t virt_addr, uint64_t count, uint64_t* phys_pages);
+
+// Same, but reports whether the whole range went: E_NOMEM if a huge page
+// could not be split, which leaves the pages from there on mapped
+kerr_t vmm_unmap_range_all(uint64_t virt_addr, uint64_t count, uint64_t* phys_pages);
+
 // Get physical address for a virtual address
 // Returns 0 if not mapped
 uint64_t vmm_get_physical(uint64_t virt_addr);
 
+// Size of the page mapping virt_addr (4KB, 2MB or 1GB), 0 if not mapped
+uint64_t vmm_get_page_size(uint64_t virt_addr);
+
 // Check if a virtual address is mapped
 int vmm_is_mapped(uint64_t virt_addr);
 
@@ -33,12 +65,84 @@ kerr_t vmm_free_page(uint64_t virt_addr);
 // Get current CR3 (page table root)
 uint64_t vmm_get_cr3(void);
 
+// Address spaces. Each has its own PML4 whose kernel half (entries 256-511)
+// and boot identity slot (entry 0, which still holds the GDT) point at the
+// kernel's tables, so only PML4 slots 1-255 are private. Kernel-half
+// mappings always go through the kernel PML4; new top-level entries there
+// reach other spaces when they are next switched to. Lower-half mappings
+// are made in the current space.
+//
+// With PCID support every space gets its own TLB tag and switching loads CR3
+// with the no-flush bit, so a task's TLB entries survive switches. Without
+// it (or with PCIDs turned off) every switch flushes the TLB.
+typedef struct vmm_space {
+    uint64_t pml4_phys;
+    uint16_t pcid;              // 0 for the kernel space
+    uint64_t kernel_gen;        // Kernel half last copied at this generation
+} vmm_space_t;
+
+#define VMM_MAX_PCIDS 4096
+
+// Allocate a PML4 sharing the kernel half and assign a PCID
+kerr_t vmm_space_init(vmm_space_t* space);
+
+// Free the space's private page tables (not the frames they map) and its
+// PCID. Must not be the current space.
+void vmm_space_destroy(vmm_space_t* space);
+
+// Make space current (NULL for the kernel space)
+void vmm_switch_space(vmm_space_t* space);
+
+// Space currently loaded in CR3 (NULL for the kernel space)
+vmm_space_t* vmm_current_space(void);
+
+// Check if PCIDs (with INVPCID) are supported and enabled in CR4
+int vmm_pcid_supported(void);
+
+// Tag switches with PCIDs (the default when supported) or flush on every
+// switch, for comparing the two. Flushes every PCID when it changes.
+void vmm_set_pcid(int enabled);
+
 // Flush TLB for a specific page
 void vmm_flush_tlb_page(uint64_t virt_addr);
 
 // Flush entire TLB
 void vmm_flush_tlb(void);
 
+// Print huge page support and usage
+void vmm_print_stats(void);
+
+// Page fault error code bits
+#define PF_PRESENT  0x01    // Protection violation (clear: page not present)
+#define PF_WRITE    0x02
+#define PF_USER     0x04
+#define PF_RESERVED 0x08
+#define PF_FETCH    0x10
+
+// A virtual area whose pages are mapped on first touch. When a not-present
+// fault hits [start, end) the handler calls fault() with the page address;
+// only faults no region resolves halt the system.
+typedef struct vm_region {
+    const char* name;
+    uint64_t start;     // Page aligned
+    uint64_t end;       // Exclusive, page aligned
+
+    // Map a page at addr, E_OK if the access can be retried
+    kerr_t (*fault)(struct vm_region* region, uint64_t addr, uint64_t error_code);
+
+    // Statistics
+    uint64_t faults;
+
+    struct vm_region* next;
+} vm_region_t;
+
+// Add a region (the struct must stay alive while registered)
+// E_EXISTS if it overlaps a registered region
+kerr_t vmm_register_region(vm_region_t* region);
+
+// Remove a region
+void vmm_unregister_region(vm_region_t* region);
+
 void page_fault_handler(uint64_t fault_addr, uint64_t error_code);
 
 #endif
\ No newline at end of file
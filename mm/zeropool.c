@@ -0,0 +1,123 @@
+#include "zeropool.h"
+#include "shrinker.h"
+#include "mm/allocators/buddy.h"
+#include "memory_layout.h"
+#include "cpu/cpu.h"
+#include "console/console.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+// A plain array keeps the pooled frames entirely zero
+static uint64_t pool[ZERO_POOL_MAX];
+static uint32_t pool_count = 0;
+
+// Statistics
+static uint64_t pool_hits = 0;
+static uint64_t pool_misses = 0;
+static uint64_t pool_zeroed = 0;
+static uint64_t pool_reclaimed = 0;
+
+uint64_t zero_pool_get(void) {
+    uint64_t flags = irq_save();
+
+    uint64_t phys = 0;
+    if (pool_count > 0) {
+        phys = pool[--pool_count];
+        pool_hits++;
+    } else {
+        pool_misses++;
+    }
+
+    irq_restore(flags);
+    return phys;
+}
+
+uint32_t zero_pool_refill(uint32_t max) {
+    uint32_t added = 0;
+
+    while (added < max && pool_count < ZERO_POOL_MAX &&
+           buddy_get_total_free_memory() >= ZERO_POOL_MIN_FREE) {
+        // Never reclaim for the pool, the shrinkers would only empty it again
+        uint64_t phys = buddy_alloc_pages(0, BUDDY_FLAG_NO_RECLAIM);
+        if (!phys) break;
+
+        memzero_nt(PHYS_TO_VIRT(phys), PAGE_SIZE);
+
+        uint64_t flags = irq_save();
+        int stored = pool_count < ZERO_POOL_MAX;
+        if (stored) {
+            pool[pool_count++] = phys;
+            pool_zeroed++;
+        }
+        irq_restore(flags);
+
+        if (!stored) {
+            buddy_free_pages(phys);
+            break;
+        }
+        added++;
+    }
+
+    return added;
+}
+
+static uint64_t zero_pool_shrinker_count(shrinker_t* shrinker) {
+    return pool_count;
+}
+
+static uint64_t zero_pool_shrinker_scan(shrinker_t* shrinker, uint64_t nr_pages) {
+    uint64_t freed = 0;
+
+    while (freed < nr_pages) {
+        uint64_t flags = irq_save();
+        uint64_t phys = pool_count > 0 ? pool[--pool_count] : 0;
+        irq_restore(flags);
+
+        if (!phys) break;
+        buddy_free_pages(phys);
+        freed++;
+    }
+
+    pool_reclaimed += freed;
+    return freed;
+}
+
+static shrinker_t zero_pool_shrinker = {
+    .name = "zeropool",
+    .count = zero_pool_shrinker_count,
+    .scan = zero_pool_shrinker_scan,
+};
+
+kerr_t zero_pool_init(void) {
+    pool_count = 0;
+    return shrinker_register(&zero_pool_shrinker);
+}
+
+void zero_pool_print_stats(void) {
+    char num_str[21];
+    console_puts("\n=== Zeroed Page Pool ===\n");
+
+    console_puts("Pooled:       ");
+    uitoa(pool_count, num_str);
+    console_puts(num_str);
+    console_puts(" / ");
+    uitoa(ZERO_POOL_MAX, num_str);
+    console_puts(num_str);
+    console_puts(" pages\n");
+
+    console_puts("Hits/misses:  ");
+    uitoa(pool_hits, num_str);
+    console_puts(num_str);
+    console_puts(" / ");
+    uitoa(pool_misses, num_str);
+    console_puts(num_str);
+    console_puts("\n");
+
+    console_puts("Zeroed idle:  ");
+    uitoa(pool_zeroed, num_str);
+    console_puts(num_str);
+    console_puts(" pages (");
+    uitoa(pool_reclaimed, num_str);
+    console_puts(num_str);
+    console_puts(" reclaimed)\n");
+}
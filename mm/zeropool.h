@@ -0,0 +1,30 @@
+#ifndef ZEROPOOL_H
+#define ZEROPOOL_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+
+// Pre-zeroed page pool - order-0 frames the idle task has already cleared.
+// buddy_alloc_pages(0, BUDDY_FLAG_ZERO) takes one from here when it can, so
+// page tables and zeroed pages skip the memset on the allocation path.
+// Pooled frames count as allocated; a shrinker hands them back under pressure.
+
+#define ZERO_POOL_MAX       256     // 1MB of zeroed frames
+#define ZERO_POOL_BATCH     16      // Frames zeroed per idle pass
+
+// Stop refilling while the buddy allocator has less than this free
+#define ZERO_POOL_MIN_FREE  (16 * 1024 * 1024)
+
+// Register the pool's shrinker (after slab_init)
+kerr_t zero_pool_init(void);
+
+// Take a zeroed frame, 0 if the pool is empty
+uint64_t zero_pool_get(void);
+
+// Zero up to max frames into the pool, returns how many were added
+uint32_t zero_pool_refill(uint32_t max);
+
+// Print pool fill and hit rate
+void zero_pool_print_stats(void);
+
+#endif
@@ -1,9 +1,13 @@
 #include "task.h"
 #include "mm/allocators/kmalloc.h"
+#include "mm/zeropool.h"
 #include "libc/string.h"
 #include "console/console.h"
 #include "io/serial.h"
 #include "drivers/pit.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
+#include "cpu/cpu.h"
 
 static task_t** task_table = NULL;     // Dynamic array of task pointers
 static uint32_t task_table_capacity = 0;
@@ -12,15 +16,90 @@ static uint32_t next_pid = 0;
 static task_t* current_task = NULL;
 static task_t* idle_task = NULL;
 
-// Simple round-robin queue
-static task_t* ready_queue_head = NULL;
-static task_t* ready_queue_tail = NULL;
-
-static task_t* sleep_queue_head = NULL;
+// One round-robin run queue per nice value, highest priority first. Bit p of
+// ready_bitmap is set while run queue p is not empty.
+static task_t* run_queue_head[TASK_PRIORITIES];
+static task_t* run_queue_tail[TASK_PRIORITIES];
+static uint64_t ready_bitmap = 0;
+
+// Sleeping tasks in a binary min-heap on wake_time, so a tick only has to
+// look at the root. Sized like task_table, so a push never allocates.
+static task_t** sleep_heap = NULL;
+static uint32_t sleep_heap_size = 0;
+
+#define TIME_SLICE_TICKS 10  // 100ms at 100Hz, for nice 0
+#define REAP_INTERVAL_TICKS 100  // ~1 second at 100Hz
+
+// Tick the scheduler last charged to the running task
+static uint64_t last_tick = 0;
+// ktime_get_ns() at the last context switch
+static uint64_t last_switch_ns = 0;
+static uint64_t last_reap_tick = 0;
+
+// Run queue index, 0 is the highest priority
+static inline uint32_t task_priority(const task_t* task) {
+    return (uint32_t)(task->nice - TASK_NICE_MIN);
+}
 
-#define TIME_SLICE_TICKS 10  // 100ms at 100Hz
+// Slice length: 20 ticks at nice -20, 10 at nice 0, 1 at nice 19
+static inline uint64_t task_time_slice(const task_t* task) {
+    return TIME_SLICE_TICKS - task->nice / 2;
+}
 #define INITIAL_TASK_CAPACITY 8
 
+// Sleep heap helpers, called with interrupts off. Each task keeps its slot
+// in sleep_index so it can be removed without a search.
+static inline void sleep_heap_set(uint32_t i, task_t* task) {
+    sleep_heap[i] = task;
+    task->sleep_index = i;
+}
+
+static void sleep_heap_sift_up(uint32_t i) {
+    task_t* task = sleep_heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (sleep_heap[parent]->wake_time <= task->wake_time) break;
+        sleep_heap_set(i, sleep_heap[parent]);
+        i = parent;
+    }
+    sleep_heap_set(i, task);
+}
+
+static void sleep_heap_sift_down(uint32_t i) {
+    task_t* task = sleep_heap[i];
+    while (1) {
+        uint32_t child = 2 * i + 1;
+        if (child >= sleep_heap_size) break;
+        if (child + 1 < sleep_heap_size &&
+            sleep_heap[child + 1]->wake_time < sleep_heap[child]->wake_time) {
+            child++;
+        }
+        if (task->wake_time <= sleep_heap[child]->wake_time) break;
+        sleep_heap_set(i, sleep_heap[child]);
+        i = child;
+    }
+    sleep_heap_set(i, task);
+}
+
+static void sleep_heap_push(task_t* task) {
+    sleep_heap[sleep_heap_size] = task;
+    sleep_heap_sift_up(sleep_heap_size++);
+}
+
+static void sleep_heap_remove(task_t* task) {
+    uint32_t i = task->sleep_index;
+    if (i == TASK_NOT_SLEEPING) return;
+    task->sleep_index = TASK_NOT_SLEEPING;
+
+    // Move the last task into the hole and restore the order around it
+    task_t* last = sleep_heap[--sleep_heap_size];
+    if (i < sleep_heap_size) {
+        sleep_heap_set(i, last);
+        sleep_heap_sift_up(i);
+        sleep_heap_sift_down(last->sleep_index);
+    }
+}
+
 // Task exit function - called when task returns
 void task_exit(void) {
     if (!current_task) return;
@@ -47,6 +126,15 @@ void task_exit(void) {
     while(1) asm volatile("hlt");
 }
 
+// Release an address space the task owns
+static void task_free_space(task_t* task) {
+    if (!task->space) return;
+
+    vmm_space_destroy(task->space);
+    kfree(task->space);
+    task->space = NULL;
+}
+
 static void scheduler_reap_terminated(void) {
     // Scan task table for terminated tasks
     for (uint32_t i = 0; i < task_table_capacity; i++) {
@@ -63,8 +151,9 @@ static void scheduler_reap_terminated(void) {
 
             // Free stack
             if (task->stack_base) {
-                kfree(task->stack_base);
+                kstack_free(task->stack_base);
             }
+            task_free_space(task);
 
             // Remove from task table
             task_table[i] = NULL;
@@ -76,22 +165,62 @@ static void scheduler_reap_terminated(void) {
     }
 }
 
-// Idle task - runs when nothing else can
-static void idle_task_entry(void) {
+// Ticks until the earliest sleeper or PIT-driven hrtimer is due, -1 if none
+static uint64_t scheduler_idle_ticks(void) {
+    uint64_t ticks = hrtimer_idle_ticks();
+    if (sleep_heap_size == 0) return ticks;
+
+    uint64_t now = pit_get_ticks();
+    uint64_t wake_time = sleep_heap[0]->wake_time;
+    uint64_t sleeper_ticks = wake_time > now ? wake_time - now : 0;
+    return sleeper_ticks < ticks ? sleeper_ticks : ticks;
+}
+
+// Idle task - runs when nothing else can. Idle time goes into zeroing
+// frames for BUDDY_FLAG_ZERO allocations; once the pool is full it halts.
+// kernel_main is the idle task (see scheduler_init) and ends up here.
+void scheduler_idle_loop(void) {
     while(1) {
-        asm volatile("hlt");
+        if (zero_pool_refill(ZERO_POOL_BATCH)) continue;
+
+        // Nothing to run: stop the tick until the next sleeper is due. sti
+        // takes effect after the hlt starts, so no wakeup is missed.
+        asm volatile("cli");
+        if (!ready_bitmap) {
+            pit_tickless_enter(scheduler_idle_ticks());
+        }
+        asm volatile("sti; hlt");
+
+        // Woken by any interrupt: restart the tick if it is still stopped
+        // and run whatever became ready without waiting for the next one
+        asm volatile("cli");
+        pit_tickless_exit();
+        scheduler_tick();
+        asm volatile("sti");
     }
 }
 
 static kerr_t task_table_grow(void) {
     uint32_t new_capacity = task_table_capacity * 2;
     task_t** new_table = kmalloc(new_capacity * sizeof(task_t*));
+    task_t** new_heap = kmalloc(new_capacity * sizeof(task_t*));
 
-    if (!new_table) {
+    if (!new_table || !new_heap) {
         serial_debug_puts("[TASK] Failed to grow task table\n");
+        if (new_table) kfree(new_table);
+        if (new_heap) kfree(new_heap);
         return E_NOMEM;
     }
 
+    // Ticks use the heap, so switch it over with interrupts off
+    uint64_t flags = irq_save();
+    for (uint32_t i = 0; i < sleep_heap_size; i++) {
+        new_heap[i] = sleep_heap[i];
+    }
+    kfree(sleep_heap);
+    sleep_heap = new_heap;
+    irq_restore(flags);
+
     // Copy old entries
     for (uint32_t i = 0; i < task_table_capacity; i++) {
         new_table[i] = task_table[i];
@@ -136,8 +265,13 @@ static uint32_t task_find_free_slot(void) {
 kerr_t task_init(void) {
     // Allocate initial task table
     task_table = kmalloc(INITIAL_TASK_CAPACITY * sizeof(task_t*));
-    if (!task_table) {
+    sleep_heap = kmalloc(INITIAL_TASK_CAPACITY * sizeof(task_t*));
+    if (!task_table || !sleep_heap) {
         serial_debug_puts("[TASK] Failed to allocate task table\n");
+        if (task_table) kfree(task_table);
+        if (sleep_heap) kfree(sleep_heap);
+        task_table = NULL;
+        sleep_heap = NULL;
         return E_NOMEM;
     }
 
@@ -150,9 +284,12 @@ kerr_t task_init(void) {
     }
 
     current_task = NULL;
-    ready_queue_head = NULL;
-    ready_queue_tail = NULL;
-    sleep_queue_head = NULL;
+    for (uint32_t i = 0; i < TASK_PRIORITIES; i++) {
+        run_queue_head[i] = NULL;
+        run_queue_tail[i] = NULL;
+    }
+    ready_bitmap = 0;
+    sleep_heap_size = 0;
 
     serial_debug_puts("[TASK] Task system initialized with capacity ");
     char cap_str[16];
@@ -164,8 +301,10 @@ kerr_t task_init(void) {
 }
 
 kerr_t scheduler_init(void) {
-    // Create idle task
-    idle_task = task_create("idle", idle_task_entry);
+    // Create idle task. It is already running: kernel_main's context is
+    // saved into it at the first switch, and kernel_main then calls
+    // scheduler_idle_loop(), so the stack set up here goes unused.
+    idle_task = task_create("idle", scheduler_idle_loop);
     if (!idle_task) {
         serial_debug_puts("[SCHEDULER] Failed to create idle task!\n");
         return E_NOMEM;
@@ -208,8 +347,8 @@ task_t* task_create(const char* name, void (*entry_point)(void)) {
         return NULL;
     }
 
-    // Allocate stack
-    task->stack_base = kmalloc(TASK_STACK_SIZE);
+    // Allocate stack (a guard page below it catches overflows)
+    task->stack_base = kstack_alloc();
     if (!task->stack_base) {
         kfree(task);
         return NULL;
@@ -223,10 +362,16 @@ task_t* task_create(const char* name, void (*entry_point)(void)) {
     strncpy(task->name, name, 31);
     task->name[31] = '\0';
     task->state = READY;
-    task->time_slice = TIME_SLICE_TICKS;
+    task->nice = TASK_NICE_DEFAULT;
+    task->on_run_queue = 0;
+    task->time_slice = task_time_slice(task);
     task->total_runtime = 0;
+    task->runtime_ns = 0;
     task->next = NULL;
+    task->prev = NULL;
     task->wake_time = 0;
+    task->sleep_index = TASK_NOT_SLEEPING;
+    task->space = NULL;
 
     // Setup initial stack with context
     uint64_t* stack_ptr = (uint64_t*)task->stack_top;
@@ -269,6 +414,28 @@ task_t* task_create(const char* name, void (*entry_point)(void)) {
     return task;
 }
 
+// Like task_create(), but the task runs in an address space of its own
+// that shares the kernel half and is freed when the task is
+task_t* task_create_isolated(const char* name, void (*entry_point)(void)) {
+    vmm_space_t* space = kmalloc(sizeof(vmm_space_t));
+    if (!space) return NULL;
+
+    if (vmm_space_init(space) != E_OK) {
+        kfree(space);
+        return NULL;
+    }
+
+    task_t* task = task_create(name, entry_point);
+    if (!task) {
+        vmm_space_destroy(space);
+        kfree(space);
+        return NULL;
+    }
+
+    task->space = space;
+    return task;
+}
+
 void task_destroy(task_t* task) {
     if (!task) return;
 
@@ -287,24 +454,16 @@ void task_destroy(task_t* task) {
     // Remove from scheduler queues
     scheduler_remove_task(task);
 
-    // Also remove from sleep queue if sleeping
-    if (sleep_queue_head == task) {
-        sleep_queue_head = task->next;
-    } else {
-        task_t* curr = sleep_queue_head;
-        while (curr && curr->next) {
-            if (curr->next == task) {
-                curr->next = task->next;
-                break;
-            }
-            curr = curr->next;
-        }
-    }
+    // Also remove from sleep heap if sleeping
+    uint64_t flags = irq_save();
+    sleep_heap_remove(task);
+    irq_restore(flags);
 
     // Free resources
     if (task->stack_base) {
-        kfree(task->stack_base);
+        kstack_free(task->stack_base);
     }
+    task_free_space(task);
 
     // Remove from table
     if (task->pid < task_table_capacity) {
@@ -319,110 +478,80 @@ task_t* task_get_current(void) {
     return current_task;
 }
 
-void scheduler_add_task(task_t* task) {
-    if (!task) return;
+static void run_queue_add(task_t* task) {
+    uint32_t prio = task_priority(task);
 
-    task->state = READY;
     task->next = NULL;
-
-    if (!ready_queue_head) {
-        ready_queue_head = task;
-        ready_queue_tail = task;
+    task->prev = run_queue_tail[prio];
+    if (task->prev) {
+        task->prev->next = task;
     } else {
-        ready_queue_tail->next = task;
-        ready_queue_tail = task;
+        run_queue_head[prio] = task;
     }
+    run_queue_tail[prio] = task;
 
+    task->on_run_queue = 1;
+    ready_bitmap |= 1ULL << prio;
 }
 
-void scheduler_remove_task(task_t* task) {
-    if (!task || !ready_queue_head) return;
+static void run_queue_remove(task_t* task) {
+    uint32_t prio = task_priority(task);
 
-    // Special case: removing head
-    if (ready_queue_head == task) {
-        ready_queue_head = task->next;
-        if (!ready_queue_head) {
-            ready_queue_tail = NULL;
-        }
-        task->next = NULL;
-        return;
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        run_queue_head[prio] = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    } else {
+        run_queue_tail[prio] = task->prev;
     }
 
-    // Search and remove
-    task_t* prev = ready_queue_head;
-    task_t* curr = ready_queue_head->next;
+    task->next = NULL;
+    task->prev = NULL;
+    task->on_run_queue = 0;
+    if (!run_queue_head[prio]) ready_bitmap &= ~(1ULL << prio);
+}
+
+void scheduler_add_task(task_t* task) {
+    // The idle task only runs when every run queue is empty
+    if (!task || task == idle_task || task->on_run_queue) return;
 
-    while (curr) {
-        if (curr == task) {
-            prev->next = curr->next;
-            if (ready_queue_tail == curr) {
-                ready_queue_tail = prev;
-            }
-            task->next = NULL;
+    task->state = READY;
+    run_queue_add(task);
+}
 
-            serial_debug_puts("[SCHEDULER] Removed task from ready queue: ");
-            serial_debug_puts(task->name);
-            serial_debug_puts("\n");
+void scheduler_remove_task(task_t* task) {
+    if (!task || !task->on_run_queue) return;
 
-            return;
-        }
-        prev = curr;
-        curr = curr->next;
-    }
+    run_queue_remove(task);
+
+    serial_debug_puts("[SCHEDULER] Removed task from ready queue: ");
+    serial_debug_puts(task->name);
+    serial_debug_puts("\n");
 }
 
 task_t* scheduler_pick_next(void) {
-    // Round-robin: pick head of queue
-    if (!ready_queue_head) {
+    if (!ready_bitmap) {
         return idle_task;  // No tasks ready, run idle
     }
 
-    task_t* next = ready_queue_head;
-
-    // Remove from head
-    ready_queue_head = next->next;
-    if (!ready_queue_head) {
-        ready_queue_tail = NULL;
-    }
-    next->next = NULL;
+    // Head of the highest-priority non-empty queue
+    task_t* next = run_queue_head[bit_scan_forward(ready_bitmap)];
+    run_queue_remove(next);
 
     return next;
 }
 
 static void scheduler_check_sleeping_tasks(void) {
-    if (!sleep_queue_head) return;
-
     uint64_t current_ticks = pit_get_ticks();
-    task_t* prev = NULL;
-    task_t* curr = sleep_queue_head;
-
-    while (curr) {
-        task_t* next = curr->next;
-
-        if (current_ticks >= curr->wake_time) {
-            if (prev) {
-                prev->next = next;
-            } else {
-                sleep_queue_head = next;
-            }
 
-            // Add to ready queue
-            curr->next = NULL;
-            scheduler_add_task(curr);
-
-            serial_debug_puts("[SCHEDULER] Woke up task: ");
-            serial_debug_puts(curr->name);
-            serial_debug_puts(" at tick ");
-            char tick_str[16];
-            uitoa(current_ticks, tick_str);
-            serial_debug_puts(tick_str);
-            serial_debug_puts("\n");
-
-            curr = next;
-        } else {
-            prev = curr;
-            curr = next;
-        }
+    // Nothing else can be due before the earliest deadline
+    while (sleep_heap_size > 0 && sleep_heap[0]->wake_time <= current_ticks) {
+        task_t* task = sleep_heap[0];
+        sleep_heap_remove(task);
+        scheduler_add_task(task);
     }
 }
 
@@ -431,54 +560,78 @@ void scheduler_tick(void) {
 
     scheduler_check_sleeping_tasks();
 
-    // Reap every 100 ticks (~1 second at 100Hz)
-    static uint64_t reap_counter = 0;
-    if (++reap_counter >= 100) {
-        reap_counter = 0;
+    uint64_t now = pit_get_ticks();
+    uint64_t elapsed = now - last_tick;
+    last_tick = now;
+
+    if (now - last_reap_tick >= REAP_INTERVAL_TICKS) {
+        last_reap_tick = now;
         scheduler_reap_terminated();
     }
 
-    // Decrement time slice
-    if (current_task->time_slice > 0) {
-        current_task->time_slice--;
+    // Charge the ticks since the last call, several after a tickless idle
+    // period and none when a task yields within a tick
+    if (current_task->time_slice > elapsed) {
+        current_task->time_slice -= elapsed;
+    } else {
+        current_task->time_slice = 0;
     }
+    current_task->total_runtime += elapsed;
 
-    // Increment runtime
-    current_task->total_runtime++;
+    // Something of higher priority became ready: preempt now, not at the end of the slice
+    if (ready_bitmap && (current_task == idle_task ||
+                         bit_scan_forward(ready_bitmap) < task_priority(current_task))) {
+        current_task->time_slice = 0;
+    }
 
     if (current_task->time_slice == 0) {
         task_t* old_task = current_task;
+
+        // Requeue the old task before picking, so it keeps the CPU unless a
+        // task of equal or higher priority is waiting
+        if (old_task->state == RUNNING) {
+            old_task->state = READY;
+            scheduler_add_task(old_task);
+        }
+
         task_t* new_task = scheduler_pick_next();
+        new_task->state = RUNNING;
+        new_task->time_slice = task_time_slice(new_task);
 
-        if (new_task && new_task != old_task) {
-            // Put old task back in queue if still ready
-            if (old_task->state == RUNNING) {
-                old_task->state = READY;
-                old_task->time_slice = TIME_SLICE_TICKS;
-                scheduler_add_task(old_task);
-            }
+        if (new_task != old_task) {
+            uint64_t now_ns = ktime_get_ns();
+            old_task->runtime_ns += now_ns - last_switch_ns;
+            last_switch_ns = now_ns;
 
-            // Switch to new task
-            new_task->state = RUNNING;
-            new_task->time_slice = TIME_SLICE_TICKS;
             current_task = new_task;
 
+            // Kernel stacks live in the shared kernel half, so the address
+            // space can change before the stack does
+            if (new_task->space != old_task->space) {
+                vmm_switch_space(new_task->space);
+            }
+
             // Perform context switch
             task_switch(&old_task->context, new_task->context);
-        } else {
-            // Just reset time slice
-            current_task->time_slice = TIME_SLICE_TICKS;
         }
     }
 }
 
+void scheduler_preempt(void) {
+    if (!current_task || !ready_bitmap) return;
+
+    if (current_task == idle_task || bit_scan_forward(ready_bitmap) < task_priority(current_task)) {
+        // Leaving idle from inside the interrupt: nothing may run with the
+        // tick stopped
+        if (current_task == idle_task) pit_tickless_exit();
+        current_task->time_slice = 0;
+        scheduler_tick();
+    }
+}
+
 void task_yield(void) {
     if (!current_task) return;
 
-    serial_debug_puts("yielding task ");
-    serial_debug_puts(current_task->name);
-    serial_debug_putc('\n');
-
     current_task->time_slice = 0;  // Force switch
     scheduler_tick();
 }
@@ -486,10 +639,6 @@ void task_yield(void) {
 void task_block(void) {
     if (!current_task) return;
 
-    serial_debug_puts("[TASK] Blocking task: ");
-    serial_debug_puts(current_task->name);
-    serial_debug_puts("\n");
-
     current_task->state = BLOCKED;
     task_yield();
 }
@@ -497,13 +646,13 @@ void task_block(void) {
 void task_unblock(task_t* task) {
     if (!task || task->state != BLOCKED) return;
 
-    serial_debug_puts("[TASK] Unblocking task: ");
-    serial_debug_puts(task->name);
-    serial_debug_puts("\n");
-
     scheduler_add_task(task);
 }
 
+int task_can_block(void) {
+    return current_task && current_task != idle_task && irq_enabled();
+}
+
 void task_sleep(uint64_t ticks) {
     if (!current_task || ticks == 0) return;
 
@@ -531,15 +680,36 @@ void task_sleep(uint64_t ticks) {
     serial_debug_puts(ticks_str);
     serial_debug_puts(")\n");
 
+    uint64_t flags = irq_save();
     current_task->state = SLEEPING;
-
-    current_task->next = sleep_queue_head;
-    sleep_queue_head = current_task;
+    sleep_heap_push(current_task);
+    irq_restore(flags);
 
     current_task->time_slice = 0;
     scheduler_tick();
 }
 
+kerr_t task_set_nice(task_t* task, int nice) {
+    if (!task || task == idle_task || nice < TASK_NICE_MIN || nice > TASK_NICE_MAX) {
+        return E_INVALID;
+    }
+
+    uint64_t flags = irq_save();
+
+    // A queued task moves to the run queue of its new priority
+    int queued = task->on_run_queue;
+    if (queued) run_queue_remove(task);
+    task->nice = (int8_t)nice;
+    if (queued) run_queue_add(task);
+
+    if (task->time_slice > task_time_slice(task)) {
+        task->time_slice = task_time_slice(task);
+    }
+
+    irq_restore(flags);
+    return E_OK;
+}
+
 task_t* task_get_by_pid(uint32_t pid) {
     if (pid >= task_table_capacity) return NULL;
     return task_table[pid];
@@ -562,8 +732,8 @@ uint32_t task_pidof(task_t* task) {
 // Utility function to print task list (for debugging)
 void task_print_list(void) {
     console_puts("\n=== Task List ===\n");
-    console_puts("PID  Name            State      Runtime\n");
-    console_puts("-------------------------------------------\n");
+    console_puts("PID  Name            State      Nice  Runtime\n");
+    console_puts("-------------------------------------------------\n");
 
     for (uint32_t i = 0; i < task_table_capacity; i++) {
         if (task_table[i]) {
@@ -616,10 +786,25 @@ void task_print_list(void) {
             len = strlen(state_str);
             for (size_t j = len; j < 11; j++) console_putc(' ');
 
-            // Runtime
-            uitoa(t->total_runtime, num_str);
+            // Nice
+            if (t->nice < 0) console_putc('-');
+            uitoa(t->nice < 0 ? -t->nice : t->nice, num_str);
+            console_puts(num_str);
+            len = strlen(num_str) + (t->nice < 0);
+            for (size_t j = len; j < 6; j++) console_putc(' ');
+
+            // Runtime, including the running task's current stretch
+            uint64_t runtime_ns = t->runtime_ns;
+            if (t == current_task) runtime_ns += ktime_get_ns() - last_switch_ns;
+            uitoa(runtime_ns / NSEC_PER_MSEC, num_str);
+            console_puts(num_str);
+            console_putc('.');
+            uint64_t frac = runtime_ns % NSEC_PER_MSEC / 1000;
+            if (frac < 100) console_putc('0');
+            if (frac < 10) console_putc('0');
+            uitoa(frac, num_str);
             console_puts(num_str);
-            console_puts(" ticks\n");
+            console_puts(" ms\n");
         }
     }
 
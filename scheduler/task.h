@@ -3,8 +3,17 @@
 
 #include "libc/stdint.h"
 #include "error_handling/errno.h"
+#include "mm/vmm.h"
+#include "mm/kstack.h"
 
-#define TASK_STACK_SIZE 8192  // 8KB stack per task
+#define TASK_STACK_SIZE KSTACK_SIZE  // 8KB guard-paged stack per task
+
+// Nice values: -20 runs first and gets the longest slice, 19 runs last.
+// Each value has its own run queue, found through a 64-bit ready bitmap.
+#define TASK_NICE_MIN     -20
+#define TASK_NICE_MAX     19
+#define TASK_NICE_DEFAULT 0
+#define TASK_PRIORITIES   (TASK_NICE_MAX - TASK_NICE_MIN + 1)
 
 typedef enum {
     READY,
@@ -26,6 +35,8 @@ typedef struct {
     uint64_t rip;  // Return address
 } __attribute__((packed)) cpu_state_t;
 
+#define TASK_NOT_SLEEPING ((uint32_t)-1)
+
 typedef struct task {
     uint32_t pid;                    // Task ID
     char name[32];                   // Task name for debugging
@@ -35,20 +46,29 @@ typedef struct task {
     void* stack_top;                 // Top of stack (grows down)
     uint64_t time_slice;             // Remaining time slice (in ticks)
     uint64_t total_runtime;          // Total ticks this task has run
+    uint64_t runtime_ns;             // Time on the CPU, by ktime_get_ns()
     uint64_t wake_time;              // Tick count to wake up for
+    int8_t nice;                     // TASK_NICE_MIN..TASK_NICE_MAX
+    uint8_t on_run_queue;            // Linked into its priority's run queue
+    uint32_t sleep_index;            // Slot in the sleep heap (TASK_NOT_SLEEPING if none)
+    vmm_space_t* space;              // Own address space (NULL: kernel space)
     struct task* next;               // Next task in scheduler queue
+    struct task* prev;               // Previous task in its run queue
 } task_t;
 
 // Task management API
 kerr_t task_init(void);
 task_t* task_create(const char* name, void (*entry_point)(void));
+task_t* task_create_isolated(const char* name, void (*entry_point)(void));
 void task_exit(void);
 void task_destroy(task_t* task);
 task_t* task_get_current(void);
 void task_yield(void);
 void task_block(void);
 void task_unblock(task_t* task);
+int task_can_block(void);  // Current task is not idle and has interrupts on
 void task_sleep(uint64_t ticks);
+kerr_t task_set_nice(task_t* task, int nice);
 task_t* task_get_by_pid(uint32_t pid);
 task_t* task_get_by_name(const char* name);
 uint32_t task_pidof(task_t* task);
@@ -60,6 +80,8 @@ void scheduler_add_task(task_t* task);
 void scheduler_remove_task(task_t* task);
 task_t* scheduler_pick_next(void);
 void scheduler_tick(void);  // Called from PIT handler
+void scheduler_preempt(void);  // From interrupts that woke a higher-priority task
+void scheduler_idle_loop(void) __attribute__((noreturn));  // kernel_main ends here
 
 // Context switching (implemented in assembly)
 void task_switch(cpu_state_t** old_context, cpu_state_t* new_context);
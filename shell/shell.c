@@ -6,6 +6,7 @@
 #include "console/console.h"
 #include "libc/string.h"
 #include "drivers/pit.h"
+#include "drivers/lapic.h"
 #include "drivers/block.h"
 #include "mm/memory.h"
 #include "fs/vfs.h"
@@ -15,8 +16,16 @@
 #include "mm/pmm.h"
 #include "mm/allocators/buddy.h"
 #include "mm/allocators/slab.h"
+#include "mm/page.h"
 #include "mm/allocators/kmalloc.h"
+#include "mm/vmalloc.h"
+#include "mm/kstack.h"
+#include "mm/zeropool.h"
+#include "mm/vmm.h"
 #include "scheduler/task.h"
+#include "cpu/cpu.h"
+#include "time/ktime.h"
+#include "time/hrtimer.h"
 
 #define CMD_BUFFER_SIZE 256
 #define BACKSPACE_DELAY_TICKS 5
@@ -32,16 +41,27 @@ static const shell_command_t commands[] = {
         {"echo", "Print text to screen", cmd_echo},
         {"about", "About IGNIS OS", cmd_about},
         {"uptime", "Show system uptime", cmd_uptime},
-        {"ticks", "Show PIT tick count", cmd_ticks},
+        {"ticks", "Show ticks, clocks and timers", cmd_ticks},
+        {"hrtimertest", "Test hrtimer ordering, cancel and schedule_timeout", cmd_hrtimertest},
         {"lsdrv","Print registered drivers", cmd_lsdrv},
         {"meminfo", "Display memory statistics", cmd_meminfo},
         {"memtest", "Run memory allocator test", cmd_memtest},
         {"pmminfo", "Show PMM info", cmd_pmminfo},
         {"pagetest", "Test page allocation", cmd_pagetest},
+        {"pmmbench", "Benchmark PMM alloc/free at 10/50/90% occupancy", cmd_pmmbench},
         {"buddyinfo", "Display buddy allocator statistics", cmd_buddyinfo},
         {"buddytest", "Test buddy allocator", cmd_buddytest},
+        {"buddybench", "Benchmark buddy free/merge cost in order and random order", cmd_buddybench},
         {"slabinfo", "Display slab allocator statistics", cmd_slabinfo},
         {"slabtest", "Test slab allocator", cmd_slabtest},
+        {"slabbench", "Benchmark slab coloring with objects across many slabs", cmd_slabbench},
+        {"kreallocbench", "Benchmark append-growth with copy vs in-place krealloc", cmd_kreallocbench},
+        {"kmallocinfo", "Display kernel memory and size class statistics", cmd_kmallocinfo},
+        {"vmallocinfo", "Display vmalloc window and huge page statistics", cmd_vmallocinfo},
+        {"vmalloctest", "Test vmalloc/vfree", cmd_vmalloctest},
+        {"vmmbench", "Benchmark per-page vs range mapping of 2MB", cmd_vmmbench},
+        {"tlbbench", "Benchmark TLB misses with 4KB vs 2MB mappings", cmd_tlbbench},
+        {"pcidbench", "Benchmark address space switches with and without PCID", cmd_pcidbench},
         {"ls", "List directory contents", cmd_ls},
         {"tree", "Display directory tree", cmd_tree},
         {"touch", "Create a new file", cmd_touch},
@@ -59,6 +79,8 @@ static const shell_command_t commands[] = {
         {"panictest", "Test panic with assertion", cmd_panictest},
         {"ps", "Print task list", cmd_ps},
         {"pidof", "Get PID of a task by name", cmd_pidof},
+        {"nice", "Run a command at another nice value", cmd_nice},
+        {"renice", "Change the nice value of a task", cmd_renice},
         {"kill", "Kill a task by PID", cmd_kill},
         {"pkill", "Kill a certain task by name", cmd_pkill},
         {"exit", "Exits the shell task", cmd_exit},
@@ -169,8 +191,9 @@ void cmd_about(int argc, char** argv) {
 }
 
 void cmd_uptime(int argc, char** argv) {
-    uint64_t ticks = pit_get_ticks();
-    uint64_t total_seconds = ticks / 100;
+    uint64_t now_ns = ktime_get_ns();
+    uint64_t total_seconds = now_ns / NSEC_PER_SEC;
+    uint64_t millis = now_ns % NSEC_PER_SEC / NSEC_PER_MSEC;
     uint64_t hours = total_seconds / 3600;
     uint64_t minutes = (total_seconds % 3600) / 60;
     uint64_t seconds = total_seconds % 60;
@@ -186,6 +209,11 @@ void cmd_uptime(int argc, char** argv) {
     console_puts("m ");
     uitoa(seconds, num_str);
     console_puts(num_str);
+    console_putc('.');
+    if (millis < 100) console_putc('0');
+    if (millis < 10) console_putc('0');
+    uitoa(millis, num_str);
+    console_puts(num_str);
     console_puts("s\n\n");
 }
 
@@ -196,7 +224,134 @@ void cmd_ticks(int argc, char** argv) {
     console_puts("\nPIT ticks: ");
     uitoa(ticks, num_str);
     console_puts(num_str);
-    console_puts("\n\n");
+    console_puts("\nTimer interrupts: ");
+    uitoa(pit_get_interrupts(), num_str);
+    console_puts(num_str);
+    console_puts("\nTickless idle periods: ");
+    uitoa(pit_get_tickless_entries(), num_str);
+    console_puts(num_str);
+
+    console_puts("\nClocksource: ");
+    if (ktime_tsc_khz()) {
+        console_puts("TSC at ");
+        uitoa(ktime_tsc_khz(), num_str);
+        console_puts(num_str);
+        console_puts(ktime_tsc_invariant() ? " kHz (invariant)" : " kHz (not invariant)");
+    } else {
+        console_puts("PIT ticks");
+    }
+    console_puts("\nktime: ");
+    uitoa(ktime_get_ns(), num_str);
+    console_puts(num_str);
+    console_puts(" ns");
+
+    console_puts("\nLAPIC timer: ");
+    if (lapic_available()) {
+        uitoa(lapic_timer_khz(), num_str);
+        console_puts(num_str);
+        console_puts(" kHz, ");
+        uitoa(lapic_get_timer_interrupts(), num_str);
+        console_puts(num_str);
+        console_puts(" interrupts");
+    } else {
+        console_puts("not available");
+    }
+    console_putc('\n');
+    hrtimer_print_stats();
+    console_putc('\n');
+}
+
+#define HRTIMERTEST_TIMERS 8
+#define HRTIMERTEST_STEP_NS (500 * NSEC_PER_USEC)
+
+static uint32_t hrtimertest_order[HRTIMERTEST_TIMERS];
+static uint64_t hrtimertest_fired_at[HRTIMERTEST_TIMERS];
+static volatile uint32_t hrtimertest_count;
+
+static void hrtimertest_fire(hrtimer_t* timer) {
+    uint32_t index = (uint32_t)(uint64_t)timer->data;
+    hrtimertest_fired_at[index] = ktime_get_ns();
+    if (hrtimertest_count < HRTIMERTEST_TIMERS) {
+        hrtimertest_order[hrtimertest_count++] = index;
+    }
+}
+
+static void hrtimertest_result(int ok, const char* pass, const char* fail) {
+    if (ok) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+        console_puts("  ✓ ");
+        console_puts(pass);
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ ");
+        console_puts(fail);
+    }
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+}
+
+void cmd_hrtimertest(int argc, char** argv) {
+    hrtimer_t timers[HRTIMERTEST_TIMERS];
+    char num_str[21];
+
+    console_puts("\n=== hrtimer Test ===\n");
+
+    console_puts("Test 1: 8 timers armed out of order, 0.5-4 ms...\n");
+    hrtimertest_count = 0;
+    uint64_t start = ktime_get_ns();
+    for (uint32_t i = 0; i < HRTIMERTEST_TIMERS; i++) {
+        // Delays 1..8 steps in a scrambled order
+        uint64_t steps = (i * 5) % HRTIMERTEST_TIMERS + 1;
+        hrtimer_setup(&timers[i], hrtimertest_fire, (void*)(uint64_t)i);
+        hrtimer_start(&timers[i], start + steps * HRTIMERTEST_STEP_NS);
+    }
+
+    schedule_timeout((HRTIMERTEST_TIMERS + 2) * HRTIMERTEST_STEP_NS);
+
+    int ok = hrtimertest_count == HRTIMERTEST_TIMERS;
+    uint64_t max_late = 0;
+    for (uint32_t i = 0; ok && i < HRTIMERTEST_TIMERS; i++) {
+        hrtimer_t* timer = &timers[hrtimertest_order[i]];
+        if (i > 0 && timer->expires_ns < timers[hrtimertest_order[i - 1]].expires_ns) ok = 0;
+
+        uint64_t late = hrtimertest_fired_at[hrtimertest_order[i]] - timer->expires_ns;
+        if (late > max_late) max_late = late;
+    }
+    for (uint32_t i = 0; i < HRTIMERTEST_TIMERS; i++) hrtimer_cancel(&timers[i]);
+
+    hrtimertest_result(ok, "Fired in expiry order, latest ", "Timers missing or out of order\n");
+    if (ok) {
+        uitoa(max_late / NSEC_PER_USEC, num_str);
+        console_puts(num_str);
+        console_puts(" us after expiry\n");
+    }
+
+    console_puts("\nTest 2: Cancel before expiry...\n");
+    hrtimertest_count = 0;
+    hrtimer_setup(&timers[0], hrtimertest_fire, (void*)0);
+    hrtimer_start(&timers[0], ktime_get_ns() + 2 * HRTIMERTEST_STEP_NS);
+    int cancelled = hrtimer_cancel(&timers[0]);
+    schedule_timeout(4 * HRTIMERTEST_STEP_NS);
+    hrtimertest_result(cancelled && hrtimertest_count == 0, "Cancelled timer never fired\n",
+                       "Cancelled timer fired\n");
+
+    console_puts("\nTest 3: schedule_timeout accuracy...\n");
+    static const uint64_t delays_us[] = {100, 1000, 10000};
+    for (uint32_t i = 0; i < sizeof(delays_us) / sizeof(delays_us[0]); i++) {
+        uint64_t before = ktime_get_ns();
+        schedule_timeout(delays_us[i] * NSEC_PER_USEC);
+        uint64_t slept = ktime_get_ns() - before;
+
+        console_puts("  ");
+        uitoa(delays_us[i], num_str);
+        console_puts(num_str);
+        console_puts(" us requested, ");
+        uitoa(slept / NSEC_PER_USEC, num_str);
+        console_puts(num_str);
+        console_puts(" us slept\n");
+    }
+
+    console_putc('\n');
+    hrtimer_print_stats();
 }
 
 void cmd_lsdrv(int argc, char** argv) {
@@ -252,6 +407,21 @@ void cmd_memtest(int argc, char** argv) {
             kfree(ptr5);
         }
 
+        console_puts("Checking ksize (33 bytes, 20000 bytes)...\n");
+        void* ptr6 = kmalloc(33);
+        void* ptr7 = kmalloc(20000);
+        if (ptr6 && ptr7 && ksize(ptr6) == 48 && ksize(ptr7) == 32768) {
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+            console_puts("✓ ksize reports 48 and 32768\n");
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+        } else {
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+            console_puts("✗ ksize mismatch\n");
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+        }
+        kfree(ptr6);
+        kfree(ptr7);
+
         console_puts("Cleaning up...\n");
         kfree(ptr1);
         kfree(ptr3);
@@ -344,20 +514,118 @@ void cmd_pagetest(int argc, char** argv) {
     }
 }
 
+#define PMMBENCH_BATCH 128
+#define PMMBENCH_ROUNDS 16
+
+static void pmmbench_print_cycles(uint64_t cycles, uint64_t ops) {
+    char num_str[32];
+    uitoa(ops ? cycles / ops : 0, num_str);
+    console_puts(num_str);
+    for (size_t j = strlen(num_str); j < 12; j++) console_putc(' ');
+}
+
+void cmd_pmmbench(int argc, char** argv) {
+    console_puts("\n=== PMM Benchmark ===\n");
+    console_puts("Boot bitmap allocator, run on the retired bitmap (no frames are touched)\n");
+
+    uint32_t total = pmm_get_total_pages();
+    uint64_t* held = kmalloc(total * sizeof(uint64_t));
+    if (!held) {
+        console_perror("Failed to allocate benchmark bookkeeping\n");
+        return;
+    }
+
+    uint64_t batch[PMMBENCH_BATCH];
+    uint32_t held_count = 0;
+    const uint32_t levels[] = {10, 50, 90};
+
+    console_puts("Cycles per operation (average):\n");
+    console_puts("Occupancy   alloc       free        alloc(8)    free(8)\n");
+
+    for (int l = 0; l < 3; l++) {
+        // Fill to the target occupancy
+        uint32_t target = (uint32_t)((uint64_t)total * levels[l] / 100);
+        while (pmm_bitmap_used_pages() < target) {
+            uint64_t page = pmm_bitmap_alloc_page();
+            if (!page) break;
+            held[held_count++] = page;
+        }
+
+        // Punch scattered holes and refill them elsewhere so free space is fragmented
+        uint32_t punched = 0;
+        for (uint32_t i = 0; i < held_count; i += 16) {
+            if (!held[i]) continue;
+            pmm_bitmap_free_page(held[i]);
+            punched++;
+        }
+        for (uint32_t i = 0; i < held_count && punched > 0; i += 16, punched--) {
+            held[i] = pmm_bitmap_alloc_page();
+        }
+
+        uint64_t alloc_cycles = 0, free_cycles = 0;
+        uint64_t alloc8_cycles = 0, free8_cycles = 0;
+        uint64_t ops = 0, ops8 = 0;
+
+        for (int r = 0; r < PMMBENCH_ROUNDS; r++) {
+            uint64_t start = rdtsc();
+            for (int i = 0; i < PMMBENCH_BATCH; i++) batch[i] = pmm_bitmap_alloc_page();
+            alloc_cycles += rdtsc() - start;
+
+            start = rdtsc();
+            for (int i = 0; i < PMMBENCH_BATCH; i++) {
+                if (batch[i]) pmm_bitmap_free_page(batch[i]);
+            }
+            free_cycles += rdtsc() - start;
+            ops += PMMBENCH_BATCH;
+
+            start = rdtsc();
+            for (int i = 0; i < PMMBENCH_BATCH / 8; i++) batch[i] = pmm_bitmap_alloc_pages(8);
+            alloc8_cycles += rdtsc() - start;
+
+            start = rdtsc();
+            for (int i = 0; i < PMMBENCH_BATCH / 8; i++) {
+                if (batch[i]) pmm_bitmap_free_pages(batch[i], 8);
+            }
+            free8_cycles += rdtsc() - start;
+            ops8 += PMMBENCH_BATCH / 8;
+        }
+
+        char num_str[32];
+        uitoa(levels[l], num_str);
+        console_puts(num_str);
+        console_puts("%");
+        for (size_t j = strlen(num_str) + 1; j < 12; j++) console_putc(' ');
+
+        pmmbench_print_cycles(alloc_cycles, ops);
+        pmmbench_print_cycles(free_cycles, ops);
+        pmmbench_print_cycles(alloc8_cycles, ops8);
+        pmmbench_print_cycles(free8_cycles, ops8);
+        console_putc('\n');
+    }
+
+    for (uint32_t i = 0; i < held_count; i++) {
+        if (held[i]) pmm_bitmap_free_page(held[i]);
+    }
+    kfree(held);
+
+    console_puts("\n");
+}
+
 void cmd_buddyinfo(int argc, char** argv) {
-    buddy_allocator_t* buddy = buddy_get_global();
-    if (!buddy) {
+    if (!buddy_get_zone(BUDDY_ZONE_DMA32)) {
         console_perror("Buddy allocator not initialized\n");
         return;
     }
 
-    buddy_print_stats(buddy);
+    buddy_print_all_stats();
+    zero_pool_print_stats();
 }
 
 void cmd_buddytest(int argc, char** argv) {
     console_puts("\n=== Buddy Allocator Test ===\n");
 
-    buddy_allocator_t* buddy = buddy_get_global();
+    // Exercise the zone that always exists
+    buddy_allocator_t* buddy = buddy_get_zone(BUDDY_ZONE_DMA32);
     if (!buddy) {
         console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
         console_puts("✗ Buddy allocator not initialized\n\n");
@@ -504,11 +772,635 @@ void cmd_buddytest(int argc, char** argv) {
     buddy_print_stats(buddy);
 }
 
+#define BUDDYBENCH_PAGES 8192
+
+// Small xorshift PRNG so runs are repeatable
+static uint64_t buddybench_next(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+void cmd_buddybench(int argc, char** argv) {
+    console_puts("\n=== Buddy Merge Benchmark ===\n");
+
+    buddy_allocator_t* buddy = buddy_get_zone(BUDDY_ZONE_DMA32);
+    if (!buddy) {
+        console_perror("Buddy allocator not initialized\n");
+        return;
+    }
+
+    // Leave half of the zone alone so the rest of the kernel keeps working
+    uint64_t count = BUDDYBENCH_PAGES;
+    if (count > buddy->free_pages / 2) count = buddy->free_pages / 2;
+
+    uint64_t* pages = kmalloc(count * sizeof(uint64_t));
+    if (!pages) {
+        console_perror("Failed to allocate benchmark bookkeeping\n");
+        return;
+    }
+
+    char num_str[32];
+    console_puts("Freeing ");
+    uitoa(count, num_str);
+    console_puts(num_str);
+    console_puts(" single pages, cycles:\n");
+    console_puts("Order       per free    max free    merges      per merge\n");
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    const char* patterns[] = {"in order", "random"};
+
+    for (int p = 0; p < 2; p++) {
+        uint64_t got = 0;
+        while (got < count) {
+            uint64_t page = buddy_alloc_order(buddy, 0);
+            if (!page) break;
+            pages[got++] = page;
+        }
+
+        // Fisher-Yates shuffle for the random pass
+        if (p == 1) {
+            for (uint64_t i = got; i > 1; i--) {
+                uint64_t j = buddybench_next(&seed) % i;
+                uint64_t tmp = pages[i - 1];
+                pages[i - 1] = pages[j];
+                pages[j] = tmp;
+            }
+        }
+
+        uint64_t merges_before = buddy->merges;
+        uint64_t total = 0, worst = 0;
+
+        for (uint64_t i = 0; i < got; i++) {
+            uint64_t start = rdtsc();
+            buddy_free(buddy, pages[i]);
+            uint64_t cycles = rdtsc() - start;
+
+            total += cycles;
+            if (cycles > worst) worst = cycles;
+        }
+
+        uint64_t merges = buddy->merges - merges_before;
+
+        console_puts(patterns[p]);
+        for (size_t j = strlen(patterns[p]); j < 12; j++) console_putc(' ');
+        pmmbench_print_cycles(total, got);
+        pmmbench_print_cycles(worst, 1);
+        pmmbench_print_cycles(merges, 1);
+        pmmbench_print_cycles(total, merges);
+        console_putc('\n');
+    }
+
+    kfree(pages);
+    console_puts("\n");
+}
+
+#define SLABBENCH_SLABS 64
+#define SLABBENCH_OBJECT_SIZE 3000
+#define SLABBENCH_ROUNDS 256
+
+void cmd_slabbench(int argc, char** argv) {
+    console_puts("\n=== Slab Coloring Benchmark ===\n");
+
+    const char* layouts[] = {"no color", "colored"};
+    uint32_t flags[] = {SLAB_HWCACHE_ALIGN | SLAB_NO_COLOR, SLAB_HWCACHE_ALIGN};
+
+    char num_str[32];
+    console_puts("Reading the first object of ");
+    uitoa(SLABBENCH_SLABS, num_str);
+    console_puts(num_str);
+    console_puts(" slabs, cycles:\n");
+    console_puts("Layout      colors      per read\n");
+
+    for (int l = 0; l < 2; l++) {
+        slab_cache_t* cache = slab_cache_create("slabbench", SLABBENCH_OBJECT_SIZE, flags[l], NULL, NULL);
+        if (!cache) {
+            console_perror("Failed to create benchmark cache\n");
+            return;
+        }
+        slab_cache_set_magazine_size(cache, 0);
+
+        uint64_t total = (uint64_t)cache->objects_per_slab * SLABBENCH_SLABS;
+        void** objs = kmalloc(total * sizeof(void*));
+        if (!objs) {
+            console_perror("Failed to allocate benchmark bookkeeping\n");
+            slab_cache_destroy(cache);
+            return;
+        }
+
+        // Fill the slabs and keep the first object of each: without coloring
+        // they all share one offset and therefore one set of cache lines
+        uint64_t got = 0;
+        void* hot[SLABBENCH_SLABS];
+        uint32_t num_hot = 0;
+        while (got < total) {
+            void* obj = slab_alloc(cache);
+            if (!obj) break;
+            objs[got++] = obj;
+
+            page_t* page = virt_to_page(obj);
+            if (obj == page->slab->objects && num_hot < SLABBENCH_SLABS) {
+                hot[num_hot++] = obj;
+            }
+        }
+
+        if (num_hot == 0) {
+            console_perror("Failed to allocate benchmark objects\n");
+            kfree(objs);
+            slab_cache_destroy(cache);
+            return;
+        }
+
+        // Chain the hot objects into a ring so every read depends on the
+        // last one and a cache miss cannot be overlapped with the next read
+        for (uint32_t i = 0; i < num_hot; i++) {
+            *(void**)hot[i] = hot[(i + 1) % num_hot];
+        }
+
+        void* volatile* cur = hot[0];
+        for (uint32_t i = 0; i < num_hot; i++) {
+            cur = *cur;
+        }
+
+        uint64_t reads = (uint64_t)num_hot * SLABBENCH_ROUNDS;
+        uint64_t start = rdtsc();
+        for (uint64_t i = 0; i < reads; i++) {
+            cur = *cur;
+        }
+        uint64_t cycles = rdtsc() - start;
+
+        console_puts(layouts[l]);
+        for (size_t j = strlen(layouts[l]); j < 12; j++) console_putc(' ');
+        pmmbench_print_cycles(cache->color_count, 1);
+        pmmbench_print_cycles(cycles, reads);
+        console_putc('\n');
+
+        for (uint64_t i = 0; i < got; i++) {
+            slab_free(cache, objs[i]);
+        }
+        kfree(objs);
+        slab_cache_destroy(cache);
+    }
+
+    console_puts("\n");
+}
+
+#define KREALLOCBENCH_STEP 4096
+#define KREALLOCBENCH_MAX (1024 * 1024)
+
+void cmd_kreallocbench(int argc, char** argv) {
+    console_puts("\n=== krealloc Append Benchmark ===\n");
+
+    char num_str[32];
+    console_puts("Appending ");
+    uitoa(KREALLOCBENCH_STEP, num_str);
+    console_puts(num_str);
+    console_puts(" bytes at a time up to ");
+    uitoa(KREALLOCBENCH_MAX / 1024, num_str);
+    console_puts(num_str);
+    console_puts(" KB:\n");
+    console_puts("Mode        moves       copied KB   cycles/append\n");
+
+    const char* modes[] = {"copy", "krealloc"};
+
+    for (int m = 0; m < 2; m++) {
+        uint8_t* buf = kmalloc(KREALLOCBENCH_STEP);
+        if (!buf) {
+            console_perror("Allocation failed\n");
+            return;
+        }
+        memset(buf, 0, KREALLOCBENCH_STEP);
+
+        uint64_t moves = 0, copied = 0, appends = 0;
+        uint64_t start = rdtsc();
+
+        for (size_t size = 2 * KREALLOCBENCH_STEP; size <= KREALLOCBENCH_MAX; size += KREALLOCBENCH_STEP) {
+            size_t old_usable = ksize(buf);
+            uint8_t* grown;
+
+            if (m == 0) {
+                // What krealloc used to do: new block, copy, free
+                grown = buf;
+                if (size > old_usable) {
+                    grown = kmalloc(size);
+                    if (grown) {
+                        memcpy(grown, buf, old_usable);
+                        kfree(buf);
+                    }
+                }
+            } else {
+                grown = krealloc(buf, size);
+            }
+
+            if (!grown) break;
+            if (grown != buf) {
+                moves++;
+                copied += old_usable;
+            }
+
+            buf = grown;
+            memset(buf + size - KREALLOCBENCH_STEP, (uint8_t)size, KREALLOCBENCH_STEP);
+            appends++;
+        }
+
+        uint64_t cycles = rdtsc() - start;
+        kfree(buf);
+
+        console_puts(modes[m]);
+        for (size_t j = strlen(modes[m]); j < 12; j++) console_putc(' ');
+        pmmbench_print_cycles(moves, 1);
+        pmmbench_print_cycles(copied / 1024, 1);
+        pmmbench_print_cycles(cycles, appends);
+        console_putc('\n');
+    }
+
+    console_puts("\n");
+}
+
 void cmd_slabinfo(int argc, char** argv) {
     console_puts("\n");
     slab_print_all_stats();
 }
 
+void cmd_kmallocinfo(int argc, char** argv) {
+    kmalloc_print_stats();
+}
+
+void cmd_vmallocinfo(int argc, char** argv) {
+    console_puts("\n");
+    vmalloc_print_stats();
+    vmm_print_stats();
+}
+
+// Twice the largest buddy block, so kmalloc could never serve it
+#define VMALLOCTEST_SIZE (16 * 1024 * 1024)
+#define VMALLOCTEST_LAZY_SIZE (64 * 1024 * 1024)
+
+void cmd_vmalloctest(int argc, char** argv) {
+    console_puts("\n=== vmalloc Test ===\n");
+
+    console_puts("Test 1: 16 MB area (larger than any buddy block)...\n");
+    uint64_t* big = vmalloc(VMALLOCTEST_SIZE);
+    if (!big || vmalloc_size(big) != VMALLOCTEST_SIZE) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ Allocation failed\n");
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+        vfree(big);
+        return;
+    }
+
+    // Tag the first and last word of every page with its index
+    uint64_t words_per_page = PAGE_SIZE / sizeof(uint64_t);
+    uint64_t pages = VMALLOCTEST_SIZE / PAGE_SIZE;
+    for (uint64_t i = 0; i < pages; i++) {
+        big[i * words_per_page] = i;
+        big[(i + 1) * words_per_page - 1] = ~i;
+    }
+
+    int ok = 1;
+    for (uint64_t i = 0; i < pages; i++) {
+        if (big[i * words_per_page] != i || big[(i + 1) * words_per_page - 1] != ~i) {
+            ok = 0;
+            break;
+        }
+    }
+
+    if (ok) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+        console_puts("  ✓ Write/Read across all 4096 pages successful\n");
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ Write/Read verification failed\n");
+    }
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+
+    console_puts("\nTest 2: vzalloc 64 KB...\n");
+    uint8_t* zeroed = vzalloc(64 * 1024);
+    ok = zeroed != NULL;
+    for (size_t i = 0; ok && i < 64 * 1024; i++) {
+        if (zeroed[i] != 0) ok = 0;
+    }
+
+    if (ok) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+        console_puts("  ✓ Area is zeroed\n");
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ vzalloc failed or area not zeroed\n");
+    }
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+
+    console_puts("\nTest 3: Free and reallocate (range should be reused)...\n");
+    vfree(big);
+    uint64_t* again = vmalloc(VMALLOCTEST_SIZE);
+
+    if (again == big) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+        console_puts("  ✓ Virtual range reused\n");
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ Range was not reused\n");
+    }
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+
+    vfree(again);
+    vfree(zeroed);
+
+    console_puts("\nTest 4: Lazy 64 MB area, touching 3 pages...\n");
+    uint64_t start = rdtsc();
+    uint8_t* lazy = vmalloc_lazy(VMALLOCTEST_LAZY_SIZE);
+    uint64_t cycles = rdtsc() - start;
+
+    uint64_t lazy_pages = VMALLOCTEST_LAZY_SIZE / PAGE_SIZE;
+    uint64_t touched[3] = {0, lazy_pages / 2, lazy_pages - 1};
+    ok = lazy != NULL;
+    for (int i = 0; ok && i < 3; i++) {
+        uint8_t* page = lazy + touched[i] * PAGE_SIZE;
+        if (vmm_is_mapped((uint64_t)page) || page[100] != 0) ok = 0;
+        page[100] = 0xAB;
+        if (page[100] != 0xAB) ok = 0;
+    }
+
+    uint64_t mapped = 0;
+    for (uint64_t i = 0; ok && i < lazy_pages; i++) {
+        if (vmm_is_mapped((uint64_t)lazy + i * PAGE_SIZE)) mapped++;
+    }
+
+    if (ok && mapped == 3) {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+        console_puts("  ✓ Reserved in ");
+        char num_str[21];
+        uitoa(cycles, num_str);
+        console_puts(num_str);
+        console_puts(" cycles, only the 3 touched pages are mapped\n");
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ Demand paging failed\n");
+    }
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+
+    vfree(lazy);
+
+    console_puts("\nCurrent vmalloc statistics:\n");
+    vmalloc_print_stats();
+}
+
+// One page table's worth of pages
+#define VMMBENCH_PAGES 512
+
+void cmd_vmmbench(int argc, char** argv) {
+    console_puts("\n=== VMM Mapping Benchmark ===\n");
+
+    // Borrow a vmalloc area for its virtual range and frames
+    uint8_t* area = vmalloc(VMMBENCH_PAGES * PAGE_SIZE);
+    uint64_t* phys = kmalloc(VMMBENCH_PAGES * sizeof(uint64_t));
+    if (!area || !phys) {
+        console_perror("Allocation failed\n");
+        vfree(area);
+        kfree(phys);
+        return;
+    }
+
+    uint64_t virt = (uint64_t)area;
+    uint64_t flags = PAGE_PRESENT | PAGE_WRITE;
+    vmm_unmap_range(virt, VMMBENCH_PAGES, phys);
+
+    console_puts("Mapping and unmapping 2 MB (512 pages):\n");
+    console_puts("Mode        map/page    unmap/page\n");
+
+    // vmm_map_page/vmm_unmap_page: a full walk and an invlpg per page
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < VMMBENCH_PAGES; i++) {
+        vmm_map_page(virt + i * PAGE_SIZE, phys[i], flags);
+    }
+    uint64_t mapped = rdtsc();
+    for (uint32_t i = 0; i < VMMBENCH_PAGES; i++) {
+        vmm_unmap_page(virt + i * PAGE_SIZE);
+    }
+    uint64_t end = rdtsc();
+
+    console_puts("per page    ");
+    pmmbench_print_cycles(mapped - start, VMMBENCH_PAGES);
+    pmmbench_print_cycles(end - mapped, VMMBENCH_PAGES);
+    console_putc('\n');
+
+    // Range calls: one walk per page table and a single flush
+    start = rdtsc();
+    vmm_map_pages(virt, phys, VMMBENCH_PAGES, flags);
+    mapped = rdtsc();
+    vmm_unmap_range(virt, VMMBENCH_PAGES, NULL);
+    end = rdtsc();
+
+    console_puts("range       ");
+    pmmbench_print_cycles(mapped - start, VMMBENCH_PAGES);
+    pmmbench_print_cycles(end - mapped, VMMBENCH_PAGES);
+    console_putc('\n');
+
+    // Put the frames back so vfree() releases them
+    vmm_map_pages(virt, phys, VMMBENCH_PAGES, flags);
+    vfree(area);
+    kfree(phys);
+
+    console_puts("\n");
+}
+
+// Up to four 8MB buddy blocks: 8192 pages at 4KB is more than the TLBs hold
+#define TLBBENCH_BLOCKS 4
+#define TLBBENCH_BLOCK_PAGES BUDDY_PAGES_PER_ORDER(BUDDY_MAX_ORDER)
+#define TLBBENCH_READS_PER_PAGE 8
+
+// Line the chase uses in page p. Lines are spread over the cache sets, so
+// the two mappings differ only in how many TLB entries they need.
+static inline void** tlbbench_node(uint8_t* const* bases, uint32_t pages_per_base, uint32_t p) {
+    return (void**)(bases[p / pages_per_base] + (uint64_t)(p % pages_per_base) * PAGE_SIZE +
+                    (p % 64) * CACHE_LINE_SIZE);
+}
+
+// Chase a ring through one line per page, visiting pages in the given order.
+// bases[] cover pages_per_base pages each. Returns cycles per read.
+static uint64_t tlbbench_chase(uint8_t* const* bases, uint32_t pages_per_base,
+                               const uint32_t* order, uint32_t pages) {
+    for (uint32_t i = 0; i < pages; i++) {
+        *tlbbench_node(bases, pages_per_base, order[i]) =
+            tlbbench_node(bases, pages_per_base, order[(i + 1) % pages]);
+    }
+
+    uint64_t reads = (uint64_t)pages * TLBBENCH_READS_PER_PAGE;
+    void** node = tlbbench_node(bases, pages_per_base, order[0]);
+
+    uint64_t start = rdtsc();
+    for (uint64_t r = 0; r < reads; r++) {
+        node = (void**)*node;
+    }
+    uint64_t cycles = rdtsc() - start;
+
+    // Keep the chase from being optimized away
+    asm volatile("" :: "r"(node));
+
+    return cycles / reads;
+}
+
+void cmd_tlbbench(int argc, char** argv) {
+    console_puts("\n=== TLB Benchmark ===\n");
+
+    uint64_t blocks[TLBBENCH_BLOCKS];
+    uint32_t nblocks = 0;
+    while (nblocks < TLBBENCH_BLOCKS) {
+        blocks[nblocks] = buddy_alloc_pages(BUDDY_MAX_ORDER, BUDDY_FLAG_NO_RECLAIM);
+        if (!blocks[nblocks]) break;
+        nblocks++;
+    }
+
+    uint32_t pages = nblocks * TLBBENCH_BLOCK_PAGES;
+    uint64_t* frames = pages ? kmalloc(pages * sizeof(uint64_t)) : NULL;
+    uint32_t* order = pages ? kmalloc(pages * sizeof(uint32_t)) : NULL;
+    if (!frames || !order) {
+        console_perror("Allocation failed\n");
+        kfree(frames);
+        kfree(order);
+        for (uint32_t b = 0; b < nblocks; b++) buddy_free_pages(blocks[b]);
+        return;
+    }
+
+    for (uint32_t i = 0; i < pages; i++) {
+        frames[i] = blocks[i / TLBBENCH_BLOCK_PAGES] + (uint64_t)(i % TLBBENCH_BLOCK_PAGES) * PAGE_SIZE;
+        order[i] = i;
+    }
+
+    // Random page order defeats the prefetchers and the page walk caches' locality
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = pages - 1; i > 0; i--) {
+        uint32_t j = buddybench_next(&seed) % (i + 1);
+        uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    // The same frames, mapped once with 4KB pages and once per block with vmap_range()
+    uint64_t flags = PAGE_PRESENT | PAGE_WRITE;
+    uint8_t* small = vmap(frames, pages, flags);
+    uint8_t* huge[TLBBENCH_BLOCKS];
+    int mapped = small != NULL;
+    for (uint32_t b = 0; b < nblocks; b++) {
+        huge[b] = vmap_range(blocks[b], TLBBENCH_BLOCK_PAGES * PAGE_SIZE, flags);
+        if (!huge[b]) mapped = 0;
+    }
+
+    if (mapped) {
+        char num_str[32];
+        console_puts("Chasing pointers through ");
+        uitoa(pages * PAGE_SIZE / (1024 * 1024), num_str);
+        console_puts(num_str);
+        console_puts(" MB, one cache line per page, random page order:\n");
+        console_puts("Mapping     TLB entries cycles/read\n");
+
+        uint64_t small_cycles = tlbbench_chase(&small, pages, order, pages);
+        uint64_t huge_cycles = tlbbench_chase(huge, TLBBENCH_BLOCK_PAGES, order, pages);
+
+        uint64_t huge_size = vmm_get_page_size((uint64_t)huge[0]);
+        const char* huge_name = huge_size == VMM_PAGE_SIZE_2M ? "2 MB        " : "4 KB        ";
+
+        console_puts("4 KB        ");
+        pmmbench_print_cycles(pages, 1);
+        pmmbench_print_cycles(small_cycles, 1);
+        console_putc('\n');
+
+        console_puts(huge_name);
+        pmmbench_print_cycles((uint64_t)pages * PAGE_SIZE / huge_size, 1);
+        pmmbench_print_cycles(huge_cycles, 1);
+        console_putc('\n');
+    } else {
+        console_perror("vmap failed\n");
+    }
+
+    vunmap(small);
+    for (uint32_t b = 0; b < nblocks; b++) {
+        vunmap(huge[b]);
+        buddy_free_pages(blocks[b]);
+    }
+    kfree(frames);
+    kfree(order);
+
+    console_puts("\n");
+}
+
+// Pages each address space touches between switches, and round trips timed
+#define PCIDBENCH_PAGES  64
+#define PCIDBENCH_ROUNDS 1000
+
+// Read one word from each of count pages
+static inline void pcidbench_touch(const uint8_t* area, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        (void)*(volatile const uint64_t*)(area + (uint64_t)i * PAGE_SIZE);
+    }
+}
+
+// Alternate between two spaces, each touching its own pages after the switch
+static void pcidbench_run(vmm_space_t* spaces, const uint8_t* area, const char* name) {
+    uint64_t switch_cycles = 0;
+    uint64_t touch_cycles = 0;
+
+    uint64_t flags = irq_save();
+    for (uint32_t round = 0; round < PCIDBENCH_ROUNDS; round++) {
+        for (uint32_t s = 0; s < 2; s++) {
+            uint64_t start = rdtsc();
+            vmm_switch_space(&spaces[s]);
+            uint64_t switched = rdtsc();
+            pcidbench_touch(area + (uint64_t)s * PCIDBENCH_PAGES * PAGE_SIZE, PCIDBENCH_PAGES);
+            uint64_t end = rdtsc();
+
+            switch_cycles += switched - start;
+            touch_cycles += end - switched;
+        }
+    }
+    vmm_switch_space(NULL);
+    irq_restore(flags);
+
+    console_puts(name);
+    pmmbench_print_cycles(switch_cycles, PCIDBENCH_ROUNDS * 2);
+    pmmbench_print_cycles(touch_cycles, (uint64_t)PCIDBENCH_ROUNDS * 2 * PCIDBENCH_PAGES);
+    console_putc('\n');
+}
+
+void cmd_pcidbench(int argc, char** argv) {
+    console_puts("\n=== Address Space Switch Benchmark ===\n");
+
+    vmm_space_t spaces[2];
+    uint8_t* area = vmalloc(2 * PCIDBENCH_PAGES * PAGE_SIZE);
+    if (!area || vmm_space_init(&spaces[0]) != E_OK) {
+        console_perror("Allocation failed\n");
+        vfree(area);
+        return;
+    }
+    if (vmm_space_init(&spaces[1]) != E_OK) {
+        console_perror("Allocation failed\n");
+        vmm_space_destroy(&spaces[0]);
+        vfree(area);
+        return;
+    }
+
+    console_puts("Switching between 2 address spaces, each reading 64 pages after a switch:\n");
+    console_puts("Mode        switch      read/page\n");
+
+    // Untagged: every CR3 load flushes the TLB, like a CPU without PCID
+    vmm_set_pcid(0);
+    pcidbench_run(spaces, area, "no PCID     ");
+
+    if (vmm_pcid_supported()) {
+        vmm_set_pcid(1);
+        pcidbench_run(spaces, area, "PCID        ");
+    } else {
+        console_puts("PCID        not supported by this CPU\n");
+    }
+
+    vmm_space_destroy(&spaces[0]);
+    vmm_space_destroy(&spaces[1]);
+    vfree(area);
+
+    console_puts("\n");
+}
+
 void cmd_slabtest(int argc, char** argv) {
     console_puts("\n=== Slab Allocator Test ===\n");
 
@@ -646,6 +1538,35 @@ void cmd_slabtest(int argc, char** argv) {
         console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
     }
 
+    console_puts("\nTest 7: Bulk allocation (32 x 64 bytes)...\n");
+    void* bulk[32];
+    if (kmalloc_bulk(64, 32, bulk) == 32) {
+        for (int i = 0; i < 32; i++) {
+            memset(bulk[i], i, 64);
+        }
+
+        int bulk_ok = 1;
+        for (int i = 0; i < 32 && bulk_ok; i++) {
+            uint8_t* obj = (uint8_t*)bulk[i];
+            if (ksize(obj) != 64 || obj[0] != i || obj[63] != i) bulk_ok = 0;
+        }
+        kfree_bulk(32, bulk);
+
+        if (bulk_ok) {
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_GREEN, CONSOLE_COLOR_BLACK});
+            console_puts("  ✓ Bulk allocation and free successful\n");
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+        } else {
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+            console_puts("  ✗ Bulk objects overlap\n");
+            console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+        }
+    } else {
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+        console_puts("  ✗ Bulk allocation failed\n");
+        console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+    }
+
     console_puts("\nCleaning up test allocations...\n");
     slab_kfree(small1);
     slab_kfree(small3);
@@ -1273,6 +2194,7 @@ void cmd_panictest(int argc, char** argv) {
 
 void cmd_ps(int argc, char** argv) {
     task_print_list();
+    kstack_print_stats();
 }
 
 void cmd_pidof(int argc, char** argv) {
@@ -1297,6 +2219,54 @@ void cmd_pidof(int argc, char** argv) {
     console_putc('\n');
 }
 
+static int shell_run_command(int argc, char** argv);
+
+void cmd_nice(int argc, char** argv) {
+    if (argc < 3) {
+        console_perror("Usage: nice <value> <command> [args]\n");
+        return;
+    }
+
+    // Run the command with the shell task reniced, then restore it
+    task_t* shell = task_get_current();
+    int old_nice = shell->nice;
+    if (task_set_nice(shell, atoi(argv[1])) != E_OK) {
+        console_perror("Nice value must be between -20 and 19\n");
+        return;
+    }
+
+    shell_run_command(argc - 2, argv + 2);
+    task_set_nice(shell, old_nice);
+}
+
+void cmd_renice(int argc, char** argv) {
+    if (argc < 3) {
+        console_perror("Usage: renice <value> <pid>\n");
+        return;
+    }
+
+    const int pid = atoi(argv[2]);
+    task_t* task = pid >= 0 ? task_get_by_pid(pid) : NULL;
+    if (!task) {
+        console_perror("Task not found\n");
+        return;
+    }
+
+    if (task_set_nice(task, atoi(argv[1])) != E_OK) {
+        console_perror("Nice value must be between -20 and 19 (idle cannot be reniced)\n");
+        return;
+    }
+
+    console_puts("Task ");
+    console_puts(task->name);
+    console_puts(" is now at nice ");
+    char nice_str[8];
+    if (task->nice < 0) console_putc('-');
+    uitoa(task->nice < 0 ? -task->nice : task->nice, nice_str);
+    console_puts(nice_str);
+    console_putc('\n');
+}
+
 void cmd_kill(int argc, char** argv) {
     if (argc < 2) {
         console_perror("Usage: pkill <task_pid>\n");
@@ -1361,6 +2331,26 @@ void cmd_banner(int argc, char** argv) {
 // COMMAND EXECUTION
 // ============================================================================
 
+// Find and execute a command, returns 0 if argv[0] is not one
+static int shell_run_command(int argc, char** argv) {
+    for (int i = 0; commands[i].name; i++) {
+        if (strcmp(argv[0], commands[i].name) == 0) {
+            commands[i].handler(argc, argv);
+            return 1;
+        }
+    }
+
+    console_puts("\n");
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
+    console_puts("Error: ");
+    console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
+    console_puts("Unknown command '");
+    console_puts(argv[0]);
+    console_puts("'\n");
+    console_puts("Type 'help' for available commands.\n\n");
+    return 0;
+}
+
 void shell_execute_command() {
     cmd_buffer[cmd_pos] = '\0';
 
@@ -1382,26 +2372,7 @@ void shell_execute_command() {
         return;
     }
 
-    // Find and execute command
-    int found = 0;
-    for (int i = 0; commands[i].name; i++) {
-        if (strcmp(argv[0], commands[i].name) == 0) {
-            commands[i].handler(argc, argv);
-            found = 1;
-            break;
-        }
-    }
-
-    if (!found) {
-        console_puts("\n");
-        console_set_color((console_color_attr_t){CONSOLE_COLOR_RED, CONSOLE_COLOR_BLACK});
-        console_puts("Error: ");
-        console_set_color((console_color_attr_t){CONSOLE_COLOR_WHITE, CONSOLE_COLOR_BLACK});
-        console_puts("Unknown command '");
-        console_puts(argv[0]);
-        console_puts("'\n");
-        console_puts("Type 'help' for available commands.\n\n");
-    }
+    shell_run_command(argc, argv);
 
     // Reset buffer and print new prompt
     memset(cmd_buffer, 0, CMD_BUFFER_SIZE);
@@ -26,15 +26,26 @@ void cmd_echo(int argc, char** argv);
 void cmd_about(int argc, char** argv);
 void cmd_uptime(int argc, char** argv);
 void cmd_ticks(int argc, char** argv);
+void cmd_hrtimertest(int argc, char** argv);
 void cmd_lsdrv(int argc, char** argv);
 void cmd_meminfo(int argc, char** argv);
 void cmd_memtest(int argc, char** argv);
 void cmd_pmminfo(int argc, char** argv);
 void cmd_pagetest(int argc, char** argv);
+void cmd_pmmbench(int argc, char** argv);
 void cmd_buddyinfo(int argc, char** argv);
 void cmd_buddytest(int argc, char** argv);
+void cmd_buddybench(int argc, char** argv);
 void cmd_slabinfo(int argc, char** argv);
 void cmd_slabtest(int argc, char** argv);
+void cmd_slabbench(int argc, char** argv);
+void cmd_kreallocbench(int argc, char** argv);
+void cmd_kmallocinfo(int argc, char** argv);
+void cmd_vmallocinfo(int argc, char** argv);
+void cmd_vmalloctest(int argc, char** argv);
+void cmd_vmmbench(int argc, char** argv);
+void cmd_tlbbench(int argc, char** argv);
+void cmd_pcidbench(int argc, char** argv);
 void cmd_ls(int argc, char** argv);
 void cmd_tree(int argc, char** argv);
 void cmd_touch(int argc, char** argv);
@@ -52,6 +63,8 @@ void cmd_panic(int argc, char** argv);
 void cmd_panictest(int argc, char** argv);
 void cmd_ps(int argc, char** argv);
 void cmd_pidof(int argc, char** argv);
+void cmd_nice(int argc, char** argv);
+void cmd_renice(int argc, char** argv);
 void cmd_kill(int argc, char** argv);
 void cmd_pkill(int argc, char** argv);
 void cmd_exit(int argc, char** argv);
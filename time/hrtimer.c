@@ -0,0 +1,265 @@
+#include "hrtimer.h"
+#include "ktime.h"
+#include "drivers/lapic.h"
+#include "drivers/pit.h"
+#include "scheduler/task.h"
+#include "cpu/cpu.h"
+#include "console/console.h"
+#include "io/serial.h"
+#include "libc/stddef.h"
+#include "libc/string.h"
+
+// Armed timers, earliest expiry at the root
+static hrtimer_t* heap[HRTIMER_MAX];
+static uint32_t heap_size = 0;
+
+static task_t* softirq_task = NULL;
+static hrtimer_t* running_timer = NULL;  // Callback in progress
+
+// Statistics
+static uint64_t timers_started = 0;
+static uint64_t timers_expired = 0;
+static uint64_t timers_cancelled = 0;
+static uint64_t softirq_runs = 0;
+
+// Heap helpers, called with interrupts off
+static inline void heap_set(uint32_t i, hrtimer_t* timer) {
+    heap[i] = timer;
+    timer->heap_index = i;
+}
+
+static void heap_sift_up(uint32_t i) {
+    hrtimer_t* timer = heap[i];
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (heap[parent]->expires_ns <= timer->expires_ns) break;
+        heap_set(i, heap[parent]);
+        i = parent;
+    }
+    heap_set(i, timer);
+}
+
+static void heap_sift_down(uint32_t i) {
+    hrtimer_t* timer = heap[i];
+    while (1) {
+        uint32_t child = 2 * i + 1;
+        if (child >= heap_size) break;
+        if (child + 1 < heap_size && heap[child + 1]->expires_ns < heap[child]->expires_ns) {
+            child++;
+        }
+        if (timer->expires_ns <= heap[child]->expires_ns) break;
+        heap_set(i, heap[child]);
+        i = child;
+    }
+    heap_set(i, timer);
+}
+
+static void heap_remove(hrtimer_t* timer) {
+    uint32_t i = timer->heap_index;
+    timer->heap_index = HRTIMER_INACTIVE;
+
+    hrtimer_t* last = heap[--heap_size];
+    if (i < heap_size) {
+        heap_set(i, last);
+        heap_sift_up(i);
+        heap_sift_down(last->heap_index);
+    }
+}
+
+static inline int timer_due(void) {
+    return heap_size > 0 && heap[0]->expires_ns <= ktime_get_ns();
+}
+
+// Point the LAPIC timer at the earliest expiry
+static void hrtimer_program(void) {
+    if (!lapic_available()) return;
+
+    if (heap_size == 0) {
+        lapic_timer_cancel();
+        return;
+    }
+
+    uint64_t now = ktime_get_ns();
+    uint64_t expires = heap[0]->expires_ns;
+    lapic_timer_oneshot(expires > now ? expires - now : 0);
+}
+
+static void hrtimer_raise_softirq(void) {
+    if (softirq_task && softirq_task->state == BLOCKED) {
+        task_unblock(softirq_task);
+    }
+}
+
+void hrtimer_interrupt(void) {
+    if (timer_due()) {
+        hrtimer_raise_softirq();
+    }
+}
+
+static void hrtimer_lapic_interrupt(void) {
+    if (timer_due()) {
+        hrtimer_raise_softirq();
+        scheduler_preempt();
+    } else {
+        // Woken early, the counter could not reach that far
+        hrtimer_program();
+    }
+}
+
+// Softirq task: run due callbacks with interrupts on, then block
+static void hrtimer_softirq_entry(void) {
+    while (1) {
+        uint64_t flags = irq_save();
+        softirq_runs++;
+
+        while (timer_due()) {
+            hrtimer_t* timer = heap[0];
+            heap_remove(timer);
+            running_timer = timer;
+            timers_expired++;
+            irq_restore(flags);
+
+            timer->fn(timer);
+
+            flags = irq_save();
+            running_timer = NULL;
+        }
+
+        hrtimer_program();
+        task_block();
+        irq_restore(flags);
+    }
+}
+
+kerr_t hrtimer_init(void) {
+    heap_size = 0;
+
+    softirq_task = task_create("hrtimer", hrtimer_softirq_entry);
+    if (!softirq_task) return E_NOMEM;
+
+    task_set_nice(softirq_task, TASK_NICE_MIN);
+    scheduler_add_task(softirq_task);
+
+    lapic_set_timer_callback(hrtimer_lapic_interrupt);
+
+    serial_debug_puts(lapic_available() ? "[HRTIMER] Using the LAPIC timer\n"
+                                        : "[HRTIMER] No LAPIC timer, using the PIT tick\n");
+    return E_OK;
+}
+
+void hrtimer_setup(hrtimer_t* timer, hrtimer_fn_t fn, void* data) {
+    timer->expires_ns = 0;
+    timer->fn = fn;
+    timer->data = data;
+    timer->heap_index = HRTIMER_INACTIVE;
+}
+
+kerr_t hrtimer_start(hrtimer_t* timer, uint64_t expires_ns) {
+    if (!timer || !timer->fn) return E_INVALID;
+
+    uint64_t flags = irq_save();
+
+    if (hrtimer_active(timer)) {
+        heap_remove(timer);
+    } else if (heap_size == HRTIMER_MAX) {
+        irq_restore(flags);
+        return E_NOMEM;
+    }
+
+    timer->expires_ns = expires_ns;
+    heap[heap_size] = timer;
+    heap_sift_up(heap_size++);
+    timers_started++;
+
+    hrtimer_program();
+
+    irq_restore(flags);
+    return E_OK;
+}
+
+int hrtimer_cancel(hrtimer_t* timer) {
+    uint64_t flags = irq_save();
+
+    int was_active = hrtimer_active(timer);
+    if (was_active) {
+        int was_first = heap[0] == timer;
+        heap_remove(timer);
+        timers_cancelled++;
+        if (was_first) hrtimer_program();
+    }
+
+    // The callback may still be running in the softirq task (unless it is
+    // the callback cancelling its own timer)
+    while (running_timer == timer && task_get_current() != softirq_task) {
+        irq_restore(flags);
+        task_yield();
+        flags = irq_save();
+    }
+
+    irq_restore(flags);
+    return was_active;
+}
+
+static void schedule_timeout_wake(hrtimer_t* timer) {
+    task_unblock((task_t*)timer->data);
+}
+
+uint64_t schedule_timeout(uint64_t ns) {
+    uint64_t deadline = ktime_get_ns() + ns;
+
+    // Without a LAPIC timers only fire on the PIT tick, so sleeping through
+    // less than a tick would stretch the wait to a whole one
+    int can_sleep = lapic_available() || ns >= NSEC_PER_SEC / PIT_TICK_HZ;
+
+    if (softirq_task && can_sleep && task_can_block()) {
+        hrtimer_t timer;
+        hrtimer_setup(&timer, schedule_timeout_wake, task_get_current());
+
+        // Interrupts stay off until the task is blocked, so the wakeup
+        // cannot come before it
+        uint64_t flags = irq_save();
+        if (hrtimer_start(&timer, deadline) == E_OK) {
+            task_block();
+            irq_restore(flags);
+            hrtimer_cancel(&timer);
+
+            uint64_t now = ktime_get_ns();
+            return now < deadline ? deadline - now : 0;
+        }
+        irq_restore(flags);
+    }
+
+    while (ktime_get_ns() < deadline) {
+        asm volatile("pause");
+    }
+    return 0;
+}
+
+uint64_t hrtimer_idle_ticks(void) {
+    if (heap_size == 0 || lapic_available()) return (uint64_t)-1;
+
+    uint64_t now = ktime_get_ns();
+    uint64_t expires = heap[0]->expires_ns;
+    if (expires <= now) return 0;
+    return (expires - now) / (NSEC_PER_SEC / PIT_TICK_HZ);
+}
+
+void hrtimer_print_stats(void) {
+    char num_str[21];
+    console_puts("hrtimers: ");
+    uitoa(heap_size, num_str);
+    console_puts(num_str);
+    console_puts(" armed, ");
+    uitoa(timers_started, num_str);
+    console_puts(num_str);
+    console_puts(" started, ");
+    uitoa(timers_expired, num_str);
+    console_puts(num_str);
+    console_puts(" expired, ");
+    uitoa(timers_cancelled, num_str);
+    console_puts(num_str);
+    console_puts(" cancelled, ");
+    uitoa(softirq_runs, num_str);
+    console_puts(num_str);
+    console_puts(" softirq runs\n");
+}
@@ -0,0 +1,63 @@
+#ifndef HRTIMER_H
+#define HRTIMER_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+
+// hrtimer - one-shot timers with nanosecond expiry on the ktime clock.
+// Armed timers sit in a min-heap on their expiry, and the LAPIC timer is
+// programmed for the earliest one. Without a LAPIC the PIT tick checks the
+// heap instead, at tick resolution. The interrupt only wakes the "hrtimer"
+// softirq task (nice -20), which runs the callbacks with interrupts enabled.
+// A callback may wake tasks and allocate from the buddy, slab and kmalloc
+// allocators, which guard their state with irq_save(). It preempts whatever
+// ran before, so it must not touch state that its owner updates with
+// interrupts enabled.
+
+#define HRTIMER_MAX         256             // Timers armed at once
+#define HRTIMER_INACTIVE    ((uint32_t)-1)
+
+typedef struct hrtimer hrtimer_t;
+typedef void (*hrtimer_fn_t)(hrtimer_t* timer);
+
+// Caller-owned timer; set up with hrtimer_setup() before first use
+struct hrtimer {
+    uint64_t expires_ns;    // ktime_get_ns() deadline
+    hrtimer_fn_t fn;        // Runs in the softirq task
+    void* data;             // For the callback
+    uint32_t heap_index;    // Slot in the timer heap (HRTIMER_INACTIVE if not armed)
+};
+
+// Create the softirq task and take over the LAPIC timer interrupt
+kerr_t hrtimer_init(void);
+
+void hrtimer_setup(hrtimer_t* timer, hrtimer_fn_t fn, void* data);
+
+// Arm timer for the absolute time expires_ns, moving it if already armed.
+// E_NOMEM if HRTIMER_MAX timers are armed.
+kerr_t hrtimer_start(hrtimer_t* timer, uint64_t expires_ns);
+
+// Disarm timer, waiting for its callback if it is running. Returns 1 if the
+// timer was armed, 0 if it had already fired or was never started.
+int hrtimer_cancel(hrtimer_t* timer);
+
+static inline int hrtimer_active(const hrtimer_t* timer) {
+    return timer->heap_index != HRTIMER_INACTIVE;
+}
+
+// Block the current task for ns nanoseconds, or until task_unblock() wakes
+// it. Returns the time left, 0 if the timeout ran out. Before the scheduler
+// runs, from the idle task, with interrupts off, or for less than a PIT tick
+// without a LAPIC timer it busy-waits instead.
+uint64_t schedule_timeout(uint64_t ns);
+
+// Timer interrupt hook: wake the softirq task if a timer is due
+void hrtimer_interrupt(void);
+
+// Ticks the PIT may stay stopped without delaying a timer (-1 if none is
+// armed or the LAPIC takes care of them)
+uint64_t hrtimer_idle_ticks(void);
+
+void hrtimer_print_stats(void);
+
+#endif
@@ -0,0 +1,101 @@
+#include "ktime.h"
+#include "drivers/pit.h"
+#include "cpu/cpu.h"
+#include "cpu/seqlock.h"
+#include "io/serial.h"
+#include "libc/string.h"
+
+// ns = ns_base + ((tsc - tsc_base) * mult) >> KTIME_SHIFT. The delta is
+// kept under a second by ktime_tick(), far from overflowing the multiply.
+#define KTIME_SHIFT 22
+
+// Shortest of a few short runs, so an SMI or emulator hiccup during one of
+// them does not skew the rate
+#define KTIME_CALIBRATE_MS   10
+#define KTIME_CALIBRATE_RUNS 3
+
+static seqlock_t clock_lock = SEQLOCK_INIT;
+static uint64_t tsc_base = 0;
+static uint64_t ns_base = 0;
+static uint64_t mult = 0;            // 0 until the TSC is calibrated
+
+static uint64_t tsc_khz = 0;
+static uint64_t rebase_cycles = 0;   // TSC cycles in a second
+static int tsc_invariant = 0;
+
+static uint64_t calibrate_tsc_khz(void) {
+    uint64_t best = (uint64_t)-1;
+
+    uint64_t flags = irq_save();
+    for (int i = 0; i < KTIME_CALIBRATE_RUNS; i++) {
+        uint64_t start = rdtsc();
+        pit_wait_ms(KTIME_CALIBRATE_MS);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) best = cycles;
+    }
+    irq_restore(flags);
+
+    return best / KTIME_CALIBRATE_MS;
+}
+
+kerr_t ktime_init(void) {
+    tsc_invariant = cpu_has_invariant_tsc();
+    tsc_khz = calibrate_tsc_khz();
+
+    char num_str[21];
+    if (tsc_khz == 0) {
+        serial_debug_puts("[KTIME] TSC calibration failed, using PIT ticks\n");
+        return E_OK;
+    }
+
+    uint64_t flags = irq_save();
+    write_seqlock(&clock_lock);
+    tsc_base = rdtsc();
+    ns_base = 0;
+    mult = (NSEC_PER_MSEC << KTIME_SHIFT) / tsc_khz;
+    write_sequnlock(&clock_lock);
+    irq_restore(flags);
+
+    rebase_cycles = tsc_khz * 1000;
+
+    serial_debug_puts("[KTIME] TSC at ");
+    uitoa(tsc_khz, num_str);
+    serial_debug_puts(num_str);
+    serial_debug_puts(tsc_invariant ? " kHz (invariant)\n" : " kHz (not invariant)\n");
+
+    return E_OK;
+}
+
+uint64_t ktime_get_ns(void) {
+    if (!mult) return pit_get_ticks() * (NSEC_PER_SEC / PIT_TICK_HZ);
+
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        seq = read_seqbegin(&clock_lock);
+        ns = ns_base + (((rdtsc() - tsc_base) * mult) >> KTIME_SHIFT);
+    } while (read_seqretry(&clock_lock, seq));
+
+    return ns;
+}
+
+void ktime_tick(void) {
+    if (!mult) return;
+
+    uint64_t tsc = rdtsc();
+    if (tsc - tsc_base < rebase_cycles) return;
+
+    // Interrupts are off in the tick, so no reader can run mid-update
+    write_seqlock(&clock_lock);
+    ns_base += ((tsc - tsc_base) * mult) >> KTIME_SHIFT;
+    tsc_base = tsc;
+    write_sequnlock(&clock_lock);
+}
+
+uint64_t ktime_tsc_khz(void) {
+    return mult ? tsc_khz : 0;
+}
+
+int ktime_tsc_invariant(void) {
+    return tsc_invariant;
+}
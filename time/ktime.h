@@ -0,0 +1,32 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include "libc/stdint.h"
+#include "error_handling/errno.h"
+
+// ktime - nanosecond clock for the whole kernel. The TSC is calibrated
+// against PIT channel 2 at boot and scaled with a multiply and shift.
+// The conversion base is moved forward from the PIT tick so the multiply
+// never overflows. A seqlock lets ktime_get_ns() run lock-free and from
+// interrupt context. Without a usable TSC the clock falls back to PIT ticks.
+
+#define NSEC_PER_USEC   1000ULL
+#define NSEC_PER_MSEC   1000000ULL
+#define NSEC_PER_SEC    1000000000ULL
+
+// Calibrate the TSC and start the clock at 0
+kerr_t ktime_init(void);
+
+// Nanoseconds since ktime_init()
+uint64_t ktime_get_ns(void);
+
+// Move the conversion base forward; called from the PIT tick
+void ktime_tick(void);
+
+// Calibrated TSC rate in kHz (0 if the PIT fallback is in use)
+uint64_t ktime_tsc_khz(void);
+
+// Non-zero if the TSC rate is constant across power states
+int ktime_tsc_invariant(void);
+
+#endif